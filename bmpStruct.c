@@ -24,6 +24,7 @@ void makeSimpleHeader( struct headerBMP* header, unsigned int width,
                        unsigned int height, unsigned int depth );
 void intToCharArr(unsigned int number, char* arr);
 void writeHeader(FILE* filePointer, struct headerBMP* header);
+void packHeader(struct headerBMP* header, char* bufferArray);
 int btyeArrayToInt(unsigned char* a);
 
 /*
@@ -70,8 +71,20 @@ void makeSimpleHeader( struct headerBMP* headerPtr, unsigned int width,
 //Header size is in bytes
 void writeHeader(FILE* filePointer, struct headerBMP* header)
 { //File must already be open for writing!!
-  char tempArray[4];
   char bufferArray[header->pixelOffset];
+  packHeader(header, bufferArray);
+  
+  //Write in the buffer array to the file
+  fwrite(bufferArray, sizeof(char), header->pixelOffset, filePointer);
+}
+
+/******************************************************************************
+ * packHeader lays the header out in bmp byte order into bufferArray, which
+ * must hold at least header->pixelOffset bytes. Used directly when the image
+ * is built up in memory instead of being written to a FILE*.
+ * ***************************************************************************/
+void packHeader(struct headerBMP* header, char* bufferArray)
+{ char tempArray[4];
   int nextOpen = 0;
 
   //Magic values
@@ -173,9 +186,6 @@ void writeHeader(FILE* filePointer, struct headerBMP* header)
   for(i=0; i<4; ++i)
   { bufferArray[nextOpen+i] = tempArray[i];
   }
-  
-  //Write in the buffer array to the file
-  fwrite(bufferArray, sizeof(char), header->pixelOffset, filePointer);
 }
 
 //integers to char arrays in little endian
@@ -21,5 +21,6 @@ struct headerBMP{
 extern void makeSimpleHeader( struct headerBMP* header, unsigned int width, 
                        unsigned int height, unsigned int depth );
 extern void writeHeader(FILE* filePointer, struct headerBMP* header);
+extern void packHeader(struct headerBMP* header, char* bufferArray);
 extern void intToCharArr(unsigned int number, char* arr);
 extern int byteArrayToInt(unsigned char a);
@@ -0,0 +1,68 @@
+#ifndef MAZEMODEL_H
+#define MAZEMODEL_H
+
+#include <stddef.h>
+
+//=======================================================================
+//Internal view of the maze model shared between the library source
+//files. Callers should only need mazegen.h.
+//
+//The grid is one contiguous block of rows*columns cells, row-major,
+//with maze[i] pointing at the start of row i. Row 0, row rows-1,
+//column 0 and column columns-1 are the SPECIAL border.
+//=======================================================================
+extern unsigned char** maze;
+extern int rows, columns;
+extern int wayX, wayY;
+
+#define PIXELS_ON_PIECE_SIDE 8
+#define PIXELS_IN_BLOCK 64
+#define PIXEL_OFFSET 54
+#define COLOR_DEPTH_IN_BYTES 3
+#define WALL_COLOR  0x7F7F7F
+#define FLOOR_COLOR 0x22B14C
+#define SOLUTION_COLOR 0xFFC90E
+#define WAYPOINT_COLOR 0xED1C24
+
+//mazegen.c
+#define MAZE_ALGORITHM_VERSION 1  //raise when a seed carves differently
+int setupMaze(int width, int height, int wayPointX, int wayPointY);
+void finishMaze(int wayPointX, int wayPointY);
+void makeWall(int row, int mode);
+void shuffle(int *array, size_t n);
+
+//mazerender.c
+void loadMazeBlocks(void);
+int blockIsWall(int directions, int k, int m);
+unsigned int cellPixel(unsigned char cell, int isWayPoint, int k, int m);
+unsigned int floorColor(unsigned char cell, int isWayPoint);
+size_t imageRowBytes(int pixelWidth);
+size_t imageFileSize(int pixelWidth, int pixelHeight);
+void imageHeader(unsigned char* out, int pixelWidth, int pixelHeight);
+size_t imageOffset(int pixelWidth, int pixelHeight, int x, int y);
+unsigned char* imagePixel(unsigned char* out, int pixelWidth,
+                          int pixelHeight, int x, int y);
+size_t mazeImageSize(int gridRows, int gridColumns);
+void renderMazeImage(const unsigned char* cells, int gridRows,
+                     int gridColumns, int wayRow, int wayColumn,
+                     unsigned char* out);
+void markDirty(int row, int col);
+void clearDirty(void);
+void releaseDirty(void);
+
+//mazestore.c
+#define ROWS_NORMAL     0
+#define ROWS_SEQUENTIAL 1  //about to be swept top to bottom
+#define ROWS_NEEDED     2  //about to be used
+#define ROWS_DONE       3  //not needed again soon
+int storageSelected(void);
+unsigned char* createMappedGrid(int gridRows, int gridColumns);
+unsigned char* openMappedGrid(const char* fileName);
+void finishMappedGrid(void);
+void releaseMappedGrid(void);
+void adviseRows(int first, int last, int hint);
+
+//mazetree.c
+void releaseIndex(void);
+
+#endif
@@ -0,0 +1,218 @@
+/********************************************************************
+* Maze Analytics
+*
+* mazeAnalyze grades the current maze in one sweep over the grid and
+* two breadth first searches, without touching the maze itself:
+*
+*   sweep:  open sides per cell, giving branching and dead ends
+*   BFS 1:  from the entrance, giving the solution path (followed back
+*           from the exit), turns, the waypoint's place on it, the
+*           corridor lengths, and the cell farthest from the entrance
+*   BFS 2:  from that farthest cell, whose own farthest cell is the
+*           other end of the longest path in the maze (its diameter)
+*
+* The two openings into the border made by makeExits are not counted
+* as open sides. The figures assume a perfect maze (a tree), as every
+* maze from mazeGenerate is. The searches still mark each cell as they
+* queue it, so a damaged grid, say a file reopened with mazeOpen,
+* cannot send them round a loop; run mazeValidate to trust the result.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define NO_PARENT 0xFF
+
+static int findExitColumn(int row, int direction);
+static int breadthFirst(int start, const unsigned char* degree,
+                        int* distance, unsigned char* parent, int* queue,
+                        int* runStart, struct mazeStats* stats);
+
+/********************************************************************
+* mazeAnalyze fills stats for the current maze. Works whether or not
+* mazeSolve has been called.
+*
+* Returns TRUE if there is no maze. Otherwise FALSE.
+********************************************************************/
+int mazeAnalyze(struct mazeStats* stats)
+{ if(maze == NULL || stats == NULL)
+  { printf("ERROR: No maze to analyze\n");
+    return TRUE;
+  }
+  int entrance = findExitColumn(1, NORTH);
+  int exitColumn = findExitColumn(rows-2, SOUTH);
+  if(entrance < 0 || exitColumn < 0)
+  { printf("ERROR: Maze has no entrance or exit\n");
+    return TRUE;
+  }
+
+  size_t gridSize = (size_t)rows*columns;
+  unsigned char* degree = calloc(gridSize, sizeof(unsigned char));
+  int* distance = malloc(gridSize*sizeof(int));
+  unsigned char* parent = malloc(gridSize*sizeof(unsigned char));
+  int* queue = malloc(gridSize*sizeof(int));
+  int* runStart = malloc(gridSize*sizeof(int));
+  if(degree == NULL || distance == NULL || parent == NULL ||
+     queue == NULL || runStart == NULL)
+  { printf("ERROR: Not enough memory to analyze the maze\n");
+    free(degree);
+    free(distance);
+    free(parent);
+    free(queue);
+    free(runStart);
+    return TRUE;
+  }
+
+  int i,j,k;
+  stats->deadEnds = 0;
+  for(k=0; k<=TOTAL_DIRECTIONS; ++k)
+  { stats->branching[k] = 0;
+  }
+  for(k=0; k<MAZE_CORRIDOR_BINS; ++k)
+  { stats->corridors[k] = 0;
+  }
+
+  //Sweep: open sides between cells of the maze
+  for(i=1; i<rows-1; ++i)
+  { const unsigned char* row = maze[i];
+    unsigned char* rowDegree = degree + (size_t)i*columns;
+    for(j=1; j<columns-1; ++j)
+    { int sides = row[j];
+      if(i == 1) sides &= ~NORTH;
+      if(i == rows-2) sides &= ~SOUTH;
+      int open = ((sides & NORTH) != 0) + ((sides & EAST) != 0) +
+                 ((sides & SOUTH) != 0) + ((sides & WEST) != 0);
+      rowDegree[j] = (unsigned char)open;
+      ++stats->branching[open];
+      if(open == 1)
+      { ++stats->deadEnds;
+      }
+    }
+  }
+
+  //BFS 1 from the entrance
+  int start = columns + entrance;
+  int farthest = breadthFirst(start, degree, distance, parent, queue,
+                              runStart, stats);
+
+  //Walk back from the exit to the entrance
+  int goal = (rows-2)*columns + exitColumn;
+  int wayPoint = wayY*columns + wayX;
+  int cell = goal;
+  if(distance[goal] < 0)
+  { printf("ERROR: Maze exit cannot be reached from the entrance\n");
+    free(degree);
+    free(distance);
+    free(parent);
+    free(queue);
+    free(runStart);
+    return TRUE;
+  }
+  int lastDirection = -1;
+  stats->solutionLength = distance[goal] + 1;
+  stats->wayPointIndex = -1;
+  stats->turns = 0;
+  while(TRUE)
+  { if(cell == wayPoint)
+    { stats->wayPointIndex = distance[cell];
+    }
+    if(parent[cell] == NO_PARENT)
+    { break;
+    }
+    if(lastDirection >= 0 && parent[cell] != lastDirection)
+    { ++stats->turns;
+    }
+    lastDirection = parent[cell];
+    cell += DIRECTION_DY[lastDirection]*columns + DIRECTION_DX[lastDirection];
+  }
+
+  //BFS 2 from the far end
+  int otherEnd = breadthFirst(farthest, degree, distance, parent, queue,
+                              NULL, NULL);
+  stats->diameter = distance[otherEnd] + 1;
+
+  free(degree);
+  free(distance);
+  free(parent);
+  free(queue);
+  free(runStart);
+  return FALSE;
+}
+
+//Returns the column in row that opens into the border, or -1
+static int findExitColumn(int row, int direction)
+{ int j;
+  for(j=1; j<columns-1; ++j)
+  { if(maze[row][j] & direction)
+    { return j;
+    }
+  }
+  return -1;
+}
+
+/********************************************************************
+* breadthFirst fills distance (in steps) and parent (index into
+* DIRECTION_LIST pointing back toward start) for every cell reached
+* from start, and returns the last cell reached, which is the farthest
+* from start. Cells not reached keep distance -1, which is also the
+* mark that stops a cell from being queued twice.
+*
+* If stats is not NULL, corridor lengths are counted too. A corridor
+* runs between two cells that do not have exactly two open sides.
+* Searching a tree, every corridor is walked away from start, so each
+* cell only needs runStart, the distance of the corridor's first cell,
+* handed down from its parent. The start cell always ends a corridor.
+********************************************************************/
+static int breadthFirst(int start, const unsigned char* degree,
+                        int* distance, unsigned char* parent, int* queue,
+                        int* runStart, struct mazeStats* stats)
+{ int head = 0, tail = 0;
+  int cell = start;
+  //Every byte 0xFF makes every distance -1
+  memset(distance, 0xFF, (size_t)rows*columns*sizeof(int));
+  queue[tail++] = start;
+  distance[start] = 0;
+  parent[start] = NO_PARENT;
+  while(head < tail)
+  { cell = queue[head++];
+    int i = cell / columns, j = cell % columns;
+    int sides = maze[i][j];
+    if(i == 1) sides &= ~NORTH;
+    if(i == rows-2) sides &= ~SOUTH;
+    if(stats != NULL)
+    { if(cell == start)
+      { runStart[cell] = 0;
+      }
+      else
+      { int above = cell + DIRECTION_DY[parent[cell]]*columns
+                         + DIRECTION_DX[parent[cell]];
+        runStart[cell] = (above == start || degree[above] != 2) ?
+                         distance[above] : runStart[above];
+        if(degree[cell] != 2)
+        { int length = distance[cell] - runStart[cell];
+          if(length >= MAZE_CORRIDOR_BINS) length = MAZE_CORRIDOR_BINS-1;
+          ++stats->corridors[length];
+        }
+      }
+    }
+    int d;
+    for(d=0; d<TOTAL_DIRECTIONS; ++d)
+    { if( !(sides & DIRECTION_LIST[d]) || d == parent[cell] )
+      { continue;
+      }
+      //Index of the opposite direction in DIRECTION_LIST
+      int back = (d + 2) % TOTAL_DIRECTIONS;
+      int next = cell + DIRECTION_DY[d]*columns + DIRECTION_DX[d];
+      if(distance[next] >= 0 || ((*maze)[next] & SPECIAL))
+      { continue;
+      }
+      distance[next] = distance[cell] + 1;
+      parent[next] = (unsigned char)back;
+      queue[tail++] = next;
+    }
+  }
+  return cell;
+}
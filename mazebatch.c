@@ -0,0 +1,313 @@
+/********************************************************************
+* Pipelined Batch Generation
+*
+* mazeBatch makes many mazes of one size and writes each to its own
+* bmp file. The work is split into three stages joined by bounded
+* queues so that carving, rendering and disk writes overlap:
+*
+*   generate (caller's thread) -> render workers -> writer thread
+*
+* The generator is the caller's own thread because mazeGenerate works
+* on the single global model and on rand(); it copies each finished
+* grid into a job and moves straight on to the next maze. Render
+* workers turn grid copies into complete bmp images, and one writer
+* thread hands each image to the OS in a single write. When a queue
+* is full the stage feeding it blocks, so a slow disk throttles the
+* generator instead of piling images up in memory.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define WRITE_ALIGNMENT 4096
+
+struct batchJob {
+  int index;
+  int gridRows, gridColumns;
+  int wayRow, wayColumn;
+  unsigned char* cells;  //copy of the grid, border included
+  unsigned char* image;  //complete bmp file
+  size_t imageSize;
+};
+
+struct batchQueue {
+  struct batchJob** slots;
+  int capacity;
+  int head, count;
+  int closed;
+  pthread_mutex_t lock;
+  pthread_cond_t notEmpty, notFull;
+};
+
+struct batchState {
+  struct batchQueue renderQueue;
+  struct batchQueue writeQueue;
+  const char* namePattern;
+  int writeErrors;        //images not rendered or not written, writer only
+};
+
+static int queueInit(struct batchQueue* queue, int capacity);
+static void queueDestroy(struct batchQueue* queue);
+static void queuePush(struct batchQueue* queue, struct batchJob* job);
+static struct batchJob* queuePop(struct batchQueue* queue);
+static void queueClose(struct batchQueue* queue);
+static void* renderWorker(void* arg);
+static void* writerWorker(void* arg);
+static int writeAll(int fd, const unsigned char* buffer, size_t size);
+
+/********************************************************************
+* mazeBatch generates count mazes and writes maze i to the file named
+* by namePattern, which is a printf format taking the maze index
+* (for example "maze%04d.bmp").
+*
+* Params:
+*   count: number of mazes to make
+*   width, height, wayPointX, wayPointY: as for mazeGenerate
+*   renderThreads: number of render workers, at least 1
+*   queueDepth: jobs each queue holds before its producer blocks
+*   namePattern: printf format for the output file names
+*
+* Returns TRUE if an argument is invalid, a thread could not be
+*   started or a maze could not be made for lack of memory or written.
+*   Otherwise FALSE. A maze that fails is skipped and the rest still
+*   get made.
+*
+* The global maze model holds the last generated maze afterwards. With
+* count 0 nothing is generated and the model is left alone.
+********************************************************************/
+int mazeBatch(int count, int width, int height,
+              int wayPointX, int wayPointY,
+              int renderThreads, int queueDepth,
+              const char* namePattern)
+{ if(count < 0 || renderThreads < 1 || queueDepth < 1 || namePattern == NULL)
+  { printf("ERROR: Invalid batch argument\n");
+    return TRUE;
+  }
+  if(count == 0)
+  { return FALSE;
+  }
+  //Check the maze arguments once up front rather than per maze
+  if(mazeGenerate(width, height, wayPointX, wayPointY, 0, 0.0, 0.0, FALSE))
+  { return TRUE;
+  }
+  loadMazeBlocks();
+
+  struct batchState state;
+  if(queueInit(&state.renderQueue, queueDepth))
+  { printf("ERROR: Not enough memory for the batch queues\n");
+    return TRUE;
+  }
+  if(queueInit(&state.writeQueue, queueDepth))
+  { printf("ERROR: Not enough memory for the batch queues\n");
+    queueDestroy(&state.renderQueue);
+    return TRUE;
+  }
+  state.namePattern = namePattern;
+  state.writeErrors = 0;
+
+  pthread_t* renderers = malloc(renderThreads*sizeof(pthread_t));
+  pthread_t writer;
+  int started = 0;
+  int failed = (renderers == NULL);
+  for(started=0; started<renderThreads && !failed; ++started)
+  { if(pthread_create(&renderers[started], NULL, renderWorker, &state) != 0)
+    { failed = TRUE;
+      break;
+    }
+  }
+  int writerStarted = FALSE;
+  if(!failed)
+  { writerStarted =
+      (pthread_create(&writer, NULL, writerWorker, &state) == 0);
+    failed = !writerStarted;
+  }
+
+  //Generate stage. The first maze was already carved by the check above
+  size_t gridSize = (size_t)rows*columns;
+  int generateErrors = 0;
+  int i;
+  for(i=0; i<count && !failed; ++i)
+  { if(i > 0 &&
+       mazeGenerate(width, height, wayPointX, wayPointY, 0, 0.0, 0.0, FALSE))
+    { ++generateErrors;
+      continue;
+    }
+    struct batchJob* job = malloc(sizeof(struct batchJob));
+    unsigned char* cells = malloc(gridSize);
+    if(job == NULL || cells == NULL)
+    { printf("ERROR: Not enough memory for maze %d of the batch\n", i);
+      ++generateErrors;
+      free(job);
+      free(cells);
+      continue;
+    }
+    job->index = i;
+    job->gridRows = rows;
+    job->gridColumns = columns;
+    job->wayRow = wayY;
+    job->wayColumn = wayX;
+    job->cells = cells;
+    memcpy(job->cells, *maze, gridSize);
+    job->image = NULL;
+    job->imageSize = 0;
+    queuePush(&state.renderQueue, job);
+  }
+
+  //Drain: renderers finish what is queued, then the writer does
+  queueClose(&state.renderQueue);
+  int t;
+  for(t=0; t<started; ++t)
+  { pthread_join(renderers[t], NULL);
+  }
+  queueClose(&state.writeQueue);
+  if(writerStarted)
+  { pthread_join(writer, NULL);
+  }
+
+  free(renderers);
+  queueDestroy(&state.renderQueue);
+  queueDestroy(&state.writeQueue);
+  if(failed)
+  { printf("ERROR: Could not start batch threads\n");
+  }
+  return failed || generateErrors > 0 || state.writeErrors > 0;
+}
+
+/********************************************************************
+* renderWorker pulls grid copies off the render queue, turns them into
+* bmp images and passes them on to the writer. Image buffers are page
+* aligned so the writer's single write per file maps onto whole pages.
+* A job with no memory for its image goes on with image NULL, and the
+* writer counts it as an error.
+********************************************************************/
+static void* renderWorker(void* arg)
+{ struct batchState* state = arg;
+  struct batchJob* job;
+  while( (job = queuePop(&state->renderQueue)) != NULL )
+  { job->imageSize = mazeImageSize(job->gridRows, job->gridColumns);
+    void* image;
+    if(posix_memalign(&image, WRITE_ALIGNMENT, job->imageSize) != 0)
+    { image = malloc(job->imageSize);
+    }
+    job->image = image;
+    if(job->image != NULL)
+    { renderMazeImage(job->cells, job->gridRows, job->gridColumns,
+                      job->wayRow, job->wayColumn, job->image);
+    }
+    free(job->cells);
+    job->cells = NULL;
+    queuePush(&state->writeQueue, job);
+  }
+  return NULL;
+}
+
+/********************************************************************
+* writerWorker is the only thread that touches the disk. Each image is
+* written with one write call (looping only on short writes).
+********************************************************************/
+static void* writerWorker(void* arg)
+{ struct batchState* state = arg;
+  struct batchJob* job;
+  char fileName[256];
+  while( (job = queuePop(&state->writeQueue)) != NULL )
+  { snprintf(fileName, sizeof(fileName), state->namePattern, job->index);
+    if(job->image == NULL)
+    { printf("ERROR: Not enough memory to render %s\n", fileName);
+      ++state->writeErrors;
+      free(job);
+      continue;
+    }
+    int fd = open(fileName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || writeAll(fd, job->image, job->imageSize))
+    { printf("ERROR: Could not write %s\n", fileName);
+      ++state->writeErrors;
+    }
+    if(fd >= 0)
+    { close(fd);
+    }
+    free(job->image);
+    free(job);
+  }
+  return NULL;
+}
+
+//Returns TRUE on a write error
+static int writeAll(int fd, const unsigned char* buffer, size_t size)
+{ while(size > 0)
+  { ssize_t written = write(fd, buffer, size);
+    if(written <= 0)
+    { return TRUE;
+    }
+    buffer += written;
+    size -= (size_t)written;
+  }
+  return FALSE;
+}
+
+/********************************************************************
+* Bounded queue of jobs. Push blocks while the queue is full, pop
+* blocks while it is empty and returns NULL once the queue has been
+* closed and drained. queueInit returns TRUE, with nothing to destroy,
+* if there is no memory for the slots.
+********************************************************************/
+static int queueInit(struct batchQueue* queue, int capacity)
+{ queue->slots = malloc((size_t)capacity*sizeof(struct batchJob*));
+  if(queue->slots == NULL)
+  { return TRUE;
+  }
+  queue->capacity = capacity;
+  queue->head = 0;
+  queue->count = 0;
+  queue->closed = FALSE;
+  pthread_mutex_init(&queue->lock, NULL);
+  pthread_cond_init(&queue->notEmpty, NULL);
+  pthread_cond_init(&queue->notFull, NULL);
+  return FALSE;
+}
+
+static void queueDestroy(struct batchQueue* queue)
+{ free(queue->slots);
+  pthread_mutex_destroy(&queue->lock);
+  pthread_cond_destroy(&queue->notEmpty);
+  pthread_cond_destroy(&queue->notFull);
+}
+
+static void queuePush(struct batchQueue* queue, struct batchJob* job)
+{ pthread_mutex_lock(&queue->lock);
+  while(queue->count == queue->capacity)
+  { pthread_cond_wait(&queue->notFull, &queue->lock);
+  }
+  queue->slots[(queue->head + queue->count) % queue->capacity] = job;
+  ++queue->count;
+  pthread_cond_signal(&queue->notEmpty);
+  pthread_mutex_unlock(&queue->lock);
+}
+
+static struct batchJob* queuePop(struct batchQueue* queue)
+{ struct batchJob* job = NULL;
+  pthread_mutex_lock(&queue->lock);
+  while(queue->count == 0 && !queue->closed)
+  { pthread_cond_wait(&queue->notEmpty, &queue->lock);
+  }
+  if(queue->count > 0)
+  { job = queue->slots[queue->head];
+    queue->head = (queue->head + 1) % queue->capacity;
+    --queue->count;
+    pthread_cond_signal(&queue->notFull);
+  }
+  pthread_mutex_unlock(&queue->lock);
+  return job;
+}
+
+static void queueClose(struct batchQueue* queue)
+{ pthread_mutex_lock(&queue->lock);
+  queue->closed = TRUE;
+  pthread_cond_broadcast(&queue->notEmpty);
+  pthread_mutex_unlock(&queue->lock);
+}
@@ -0,0 +1,132 @@
+/********************************************************************
+* Maze Generation Benchmark
+*
+* Usage: mazebench [width height mazes rounds]
+*
+* Times mazeGenerate on the same seeds with the shaping arguments off
+* (the plain randomized depth first carve) and with each of them on,
+* then all together. Each setting is run rounds times, interleaved
+* with the others, and the fastest round counts. Prints cells carved
+* per second and the speed relative to the plain carve.
+*
+* Defaults: 1000 by 1000, 10 mazes, 5 rounds.
+********************************************************************/
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "mazegen.h"
+
+const int DIRECTION_LIST[] = {NORTH, EAST, SOUTH, WEST};
+const int DIRECTION_DX[]   = {    0,    1,     0,   -1};
+const int DIRECTION_DY[]   = {   -1,    0,     1,    0};
+
+const unsigned char pipeList[] =
+{
+  219, 208, 198, 200, 210, 186, 201, 204,
+  181, 188, 205, 202, 187, 185, 203, 206
+};
+
+//Not used by the benchmark, the library only needs it to be defined
+void textcolor(int color)
+{ (void)color;
+}
+
+struct setting {
+  const char* name;
+  int alley;
+  double toward;
+  double straight;
+  double best;                    //seconds for the fastest round
+};
+
+static struct setting settings[] = {
+  { "plain",            0, 0.0, 0.0, 0.0 },
+  { "straight 0.5",     0, 0.0, 0.5, 0.0 },
+  { "toward 0.5",       0, 0.5, 0.0, 0.0 },
+  { "alley",           -1, 0.0, 0.0, 0.0 },  //alley set from the size
+  { "all",             -1, 0.5, 0.5, 0.0 },
+};
+#define TOTAL_SETTINGS ((int)(sizeof(settings)/sizeof(settings[0])))
+
+static int width = 1000, height = 1000, mazes = 10, rounds = 5;
+
+static double now(void);
+static void* runBenchmark(void* arg);
+
+
+int main(int argc, char** argv)
+{ if(argc > 1 && argc < 5)
+  { printf("Usage: %s [width height mazes rounds]\n", argv[0]);
+    return TRUE;
+  }
+  if(argc > 1)
+  { width = atoi(argv[1]);
+    height = atoi(argv[2]);
+    mazes = atoi(argv[3]);
+    rounds = atoi(argv[4]);
+  }
+  if(width < 3 || height < 3 || mazes < 1 || rounds < 1)
+  { printf("ERROR: Arguments out of range\n");
+    return TRUE;
+  }
+
+  //carveMaze recurses once per cell, so carve on a thread with room
+  size_t stackSize = (size_t)width*height*MAZE_STACK_PER_CELL;
+  if(stackSize < MAZE_STACK_MINIMUM)
+  { stackSize = MAZE_STACK_MINIMUM;
+  }
+  pthread_attr_t attributes;
+  pthread_t thread;
+  pthread_attr_init(&attributes);
+  pthread_attr_setstacksize(&attributes, stackSize);
+  if(pthread_create(&thread, &attributes, runBenchmark, NULL) != 0)
+  { printf("ERROR: Could not start the benchmark thread\n");
+    return TRUE;
+  }
+  pthread_join(thread, NULL);
+  pthread_attr_destroy(&attributes);
+
+  double cells = (double)width*height*mazes;
+  int s;
+  printf("%d mazes of %d by %d, best of %d rounds\n",
+         mazes, width, height, rounds);
+  for(s=0; s<TOTAL_SETTINGS; ++s)
+  { printf("%-14s %8.2f Mcells/s  %6.1f%% of plain\n", settings[s].name,
+           cells / settings[s].best / 1e6,
+           100.0 * settings[0].best / settings[s].best);
+  }
+  return FALSE;
+}
+
+static double now(void)
+{ struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec*1e-9;
+}
+
+//Every round runs every setting once over the same seeds
+static void* runBenchmark(void* arg)
+{ (void)arg;
+  int alley = (width < height ? width : height) / 4;
+  int r, s, m;
+  for(r=0; r<rounds; ++r)
+  { for(s=0; s<TOTAL_SETTINGS; ++s)
+    { double start = now();
+      for(m=0; m<mazes; ++m)
+      { srand((unsigned int)m);
+        mazeGenerate(width, height, (width+1)/2, (height+1)/2,
+                     settings[s].alley < 0 ? alley : settings[s].alley,
+                     settings[s].toward, settings[s].straight, FALSE);
+      }
+      double elapsed = now() - start;
+      if(r == 0 || elapsed < settings[s].best)
+      { settings[s].best = elapsed;
+      }
+    }
+  }
+  mazeFree();
+  return NULL;
+}
@@ -0,0 +1,408 @@
+/********************************************************************
+* Maze Cache
+*
+* Keeps recently generated mazes in memory, keyed by everything that
+* decides what mazeGenerate carves: width, height, waypoint, the seed
+* handed to srand, MAZE_ALGORITHM_VERSION and whether mazeStorage has
+* named a file, since file backed mazes are carved in bands and come
+* out differently for the same seed. Asking for the same key
+* again unpacks the stored maze instead of carving it, and
+* mazeRenderCached hands back a stored copy of its bmp image instead
+* of rasterizing it.
+*
+* Mazes are stored compact, as the direction bits of the interior
+* cells packed two to a byte; the border and the exit's GOAL mark are
+* rebuilt when a maze is unpacked. Images are optional and are only
+* stored once asked for.
+*
+* Entries live in a hash table for lookup and on a list from most to
+* least recently used. When the bytes held go over the budget, entries
+* are dropped from the least recently used end. Running out of memory
+* only means a maze or image is not cached.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+struct cacheEntry {
+  int width, height;
+  int wayPointX, wayPointY;
+  unsigned int seed;
+  int version;
+  int banded;                //carved by carveBands into a mapped file
+  unsigned int hash;
+  struct cacheEntry* nextInBucket;
+  struct cacheEntry* newer;  //toward the most recently used
+  struct cacheEntry* older;  //toward the least recently used
+  unsigned char* cells;      //interior direction bits, two per byte
+  unsigned char* image;      //complete bmp file, or NULL
+  size_t imageSize;
+};
+
+static struct cacheEntry** buckets = NULL;
+static size_t bucketCount = 0;
+static struct cacheEntry* newest = NULL;
+static struct cacheEntry* oldest = NULL;
+static size_t byteBudget = 0;
+static int keepImages = FALSE;
+static struct mazeCacheStats counters;
+
+static unsigned int hashKey(int width, int height, int wayPointX,
+                            int wayPointY, unsigned int seed, int banded);
+static struct cacheEntry* findEntry(int width, int height, int wayPointX,
+                                    int wayPointY, unsigned int seed);
+static struct cacheEntry* addEntry(int width, int height, int wayPointX,
+                                   int wayPointY, unsigned int seed);
+static void touchEntry(struct cacheEntry* entry);
+static void dropEntry(struct cacheEntry* entry);
+static void trimCache(void);
+static size_t entryBytes(const struct cacheEntry* entry);
+static size_t packedBytes(int width, int height);
+static void packMaze(unsigned char* packed);
+static void unpackMaze(const struct cacheEntry* entry, unsigned char* cells);
+
+/********************************************************************
+* mazeCacheSetup sets how many bytes the cache may hold, counting the
+* packed mazes, stored images and bookkeeping, and whether
+* mazeRenderCached stores images. A budget of 0 turns the cache off.
+* Entries over a smaller budget are dropped right away, and the
+* counters start again from zero.
+********************************************************************/
+void mazeCacheSetup(size_t budget, int storeImages)
+{ byteBudget = budget;
+  keepImages = storeImages;
+  if(!keepImages)
+  { struct cacheEntry* entry;
+    for(entry=newest; entry!=NULL; entry=entry->older)
+    { counters.bytes -= entry->imageSize;
+      free(entry->image);
+      entry->image = NULL;
+      entry->imageSize = 0;
+    }
+  }
+  trimCache();
+  if(newest == NULL)
+  { free(buckets);
+    buckets = NULL;
+    bucketCount = 0;
+  }
+  counters.hits = 0;
+  counters.misses = 0;
+  counters.imageHits = 0;
+  counters.imageMisses = 0;
+  counters.evictions = 0;
+}
+
+//Copies out the counters and the current size of the cache
+void mazeCacheCounters(struct mazeCacheStats* stats)
+{ *stats = counters;
+}
+
+/********************************************************************
+* mazeGenerateCached makes the maze that srand(seed) followed by
+* mazeGenerate(width, height, wayPointX, wayPointY, ...) would make
+* the current maze, from the cache when it holds it.
+*
+* Returns TRUE if one or more parameters are out of range.
+********************************************************************/
+int mazeGenerateCached(int width, int height,
+                       int wayPointX, int wayPointY, unsigned int seed)
+{ struct cacheEntry* entry = findEntry(width, height, wayPointX, wayPointY,
+                                      seed);
+  if(entry == NULL)
+  { ++counters.misses;
+    srand(seed);
+    if(mazeGenerate(width, height, wayPointX, wayPointY, 0, 0.0, 0.0, FALSE))
+    { return TRUE;
+    }
+    entry = addEntry(width, height, wayPointX, wayPointY, seed);
+    if(entry != NULL)
+    { packMaze(entry->cells);
+      trimCache();
+    }
+    return FALSE;
+  }
+
+  ++counters.hits;
+  touchEntry(entry);
+  if(setupMaze(width, height, wayPointX, wayPointY))
+  { return TRUE;
+  }
+  unpackMaze(entry, *maze);
+  wayX = wayPointX;
+  wayY = wayPointY;
+  finishMappedGrid();
+  return FALSE;
+}
+
+/********************************************************************
+* mazeRenderCached returns the bmp image of the maze for this key as
+* generated, without a solution, in a new buffer the caller frees,
+* and stores the size in imageSize. The image is kept in the cache if
+* images are being stored. The current maze is only replaced if the
+* maze itself has to be generated.
+*
+* Returns NULL if one or more parameters are out of range or there is
+* not enough memory for the image.
+********************************************************************/
+unsigned char* mazeRenderCached(int width, int height,
+                                int wayPointX, int wayPointY,
+                                unsigned int seed, size_t* imageSize)
+{ struct cacheEntry* entry = findEntry(width, height, wayPointX, wayPointY,
+                                      seed);
+  unsigned char* image;
+  if(entry != NULL && entry->image != NULL)
+  { ++counters.imageHits;
+    touchEntry(entry);
+    image = malloc(entry->imageSize);
+    if(image == NULL)
+    { printf("ERROR: Not enough memory for the maze image\n");
+      return NULL;
+    }
+    *imageSize = entry->imageSize;
+    memcpy(image, entry->image, entry->imageSize);
+    return image;
+  }
+
+  ++counters.imageMisses;
+  if(entry == NULL)
+  { if(mazeGenerateCached(width, height, wayPointX, wayPointY, seed))
+    { return NULL;
+    }
+    entry = findEntry(width, height, wayPointX, wayPointY, seed);
+  }
+  int gridRows = height+2, gridColumns = width+2;
+  *imageSize = mazeImageSize(gridRows, gridColumns);
+  image = malloc(*imageSize);
+  unsigned char* cells = NULL;
+  if(entry != NULL && image != NULL)
+  { cells = malloc((size_t)gridRows*gridColumns);
+  }
+  if(image == NULL || (entry != NULL && cells == NULL))
+  { printf("ERROR: Not enough memory for the maze image\n");
+    free(image);
+    return NULL;
+  }
+  loadMazeBlocks();
+  if(entry != NULL)
+  { unpackMaze(entry, cells);
+    renderMazeImage(cells, gridRows, gridColumns, wayPointY, wayPointX,
+                    image);
+    free(cells);
+  }
+  else
+  { //Too big for the budget: the current maze is the one asked for
+    renderMazeImage(*maze, gridRows, gridColumns, wayPointY, wayPointX,
+                    image);
+  }
+
+  if(entry != NULL && keepImages)
+  { entry->image = malloc(*imageSize);
+    if(entry->image == NULL)
+    { return image;
+    }
+    memcpy(entry->image, image, *imageSize);
+    entry->imageSize = *imageSize;
+    counters.bytes += *imageSize;
+    touchEntry(entry);
+    trimCache();
+  }
+  return image;
+}
+
+//FNV-1a over the key
+static unsigned int hashKey(int width, int height, int wayPointX,
+                            int wayPointY, unsigned int seed, int banded)
+{ unsigned int key[7];
+  key[0] = (unsigned int)width;
+  key[1] = (unsigned int)height;
+  key[2] = (unsigned int)wayPointX;
+  key[3] = (unsigned int)wayPointY;
+  key[4] = seed;
+  key[5] = MAZE_ALGORITHM_VERSION;
+  key[6] = (unsigned int)banded;
+  unsigned int hash = 2166136261u;
+  const unsigned char* bytes = (const unsigned char*)key;
+  size_t i;
+  for(i=0; i<sizeof(key); ++i)
+  { hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+//Returns the entry for the key, or NULL if it is not cached
+static struct cacheEntry* findEntry(int width, int height, int wayPointX,
+                                    int wayPointY, unsigned int seed)
+{ if(bucketCount == 0)
+  { return NULL;
+  }
+  int banded = storageSelected();
+  unsigned int hash = hashKey(width, height, wayPointX, wayPointY, seed,
+                              banded);
+  struct cacheEntry* entry = buckets[hash & (bucketCount-1)];
+  for(; entry!=NULL; entry=entry->nextInBucket)
+  { if(entry->hash == hash && entry->width == width &&
+       entry->height == height && entry->wayPointX == wayPointX &&
+       entry->wayPointY == wayPointY && entry->seed == seed &&
+       entry->version == MAZE_ALGORITHM_VERSION && entry->banded == banded)
+    { return entry;
+    }
+  }
+  return NULL;
+}
+
+/********************************************************************
+* addEntry makes a new most recently used entry for the key with room
+* for the packed maze. The table doubles when it holds more entries
+* than buckets.
+*
+* Returns NULL if the maze alone would not fit in the budget or there
+* is not enough memory for the entry.
+********************************************************************/
+static struct cacheEntry* addEntry(int width, int height, int wayPointX,
+                                   int wayPointY, unsigned int seed)
+{ if(sizeof(struct cacheEntry) + packedBytes(width, height) > byteBudget)
+  { return NULL;
+  }
+  if(counters.entries >= bucketCount)
+  { size_t newCount = bucketCount ? 2*bucketCount : 64;
+    struct cacheEntry** newBuckets = calloc(newCount,
+                                            sizeof(struct cacheEntry*));
+    if(newBuckets == NULL)
+    { return NULL;
+    }
+    struct cacheEntry* entry;
+    for(entry=newest; entry!=NULL; entry=entry->older)
+    { size_t b = entry->hash & (newCount-1);
+      entry->nextInBucket = newBuckets[b];
+      newBuckets[b] = entry;
+    }
+    free(buckets);
+    buckets = newBuckets;
+    bucketCount = newCount;
+  }
+
+  struct cacheEntry* entry = malloc(sizeof(struct cacheEntry));
+  if(entry == NULL)
+  { return NULL;
+  }
+  entry->cells = malloc(packedBytes(width, height));
+  if(entry->cells == NULL)
+  { free(entry);
+    return NULL;
+  }
+  entry->width = width;
+  entry->height = height;
+  entry->wayPointX = wayPointX;
+  entry->wayPointY = wayPointY;
+  entry->seed = seed;
+  entry->version = MAZE_ALGORITHM_VERSION;
+  entry->banded = storageSelected();
+  entry->hash = hashKey(width, height, wayPointX, wayPointY, seed,
+                        entry->banded);
+  entry->image = NULL;
+  entry->imageSize = 0;
+
+  size_t b = entry->hash & (bucketCount-1);
+  entry->nextInBucket = buckets[b];
+  buckets[b] = entry;
+  entry->newer = NULL;
+  entry->older = newest;
+  if(newest != NULL) newest->newer = entry;
+  newest = entry;
+  if(oldest == NULL) oldest = entry;
+  ++counters.entries;
+  counters.bytes += entryBytes(entry);
+  return entry;
+}
+
+//Moves entry to the most recently used end of the list
+static void touchEntry(struct cacheEntry* entry)
+{ if(entry == newest)
+  { return;
+  }
+  entry->newer->older = entry->older;
+  if(entry->older != NULL) entry->older->newer = entry->newer;
+  else oldest = entry->newer;
+  entry->newer = NULL;
+  entry->older = newest;
+  newest->newer = entry;
+  newest = entry;
+}
+
+//Takes entry out of the table and the list and frees it
+static void dropEntry(struct cacheEntry* entry)
+{ struct cacheEntry** link = &buckets[entry->hash & (bucketCount-1)];
+  while(*link != entry)
+  { link = &(*link)->nextInBucket;
+  }
+  *link = entry->nextInBucket;
+  if(entry->newer != NULL) entry->newer->older = entry->older;
+  else newest = entry->older;
+  if(entry->older != NULL) entry->older->newer = entry->newer;
+  else oldest = entry->newer;
+  --counters.entries;
+  counters.bytes -= entryBytes(entry);
+  free(entry->cells);
+  free(entry->image);
+  free(entry);
+}
+
+//Drops least recently used entries until the cache is within budget
+static void trimCache(void)
+{ while(oldest != NULL && counters.bytes > byteBudget)
+  { dropEntry(oldest);
+    ++counters.evictions;
+  }
+}
+
+static size_t entryBytes(const struct cacheEntry* entry)
+{ return sizeof(struct cacheEntry) +
+         packedBytes(entry->width, entry->height) + entry->imageSize;
+}
+
+static size_t packedBytes(int width, int height)
+{ return ((size_t)width*height + 1) / 2;
+}
+
+//Packs the direction bits of the current maze's interior cells
+static void packMaze(unsigned char* packed)
+{ size_t n = 0;
+  int i,j;
+  for(i=1; i<rows-1; ++i)
+  { for(j=1; j<columns-1; ++j, ++n)
+    { unsigned char sides = maze[i][j] & ALL_DIRECTIONS;
+      if(n & 1) packed[n/2] |= (unsigned char)(sides << 4);
+      else packed[n/2] = sides;
+    }
+  }
+}
+
+/********************************************************************
+* unpackMaze rebuilds the full grid of entry, border included, in
+* cells: SPECIAL border, the interior's direction bits, and GOAL on
+* the exit, which is the bottom row cell open to the SOUTH.
+********************************************************************/
+static void unpackMaze(const struct cacheEntry* entry, unsigned char* cells)
+{ int gridColumns = entry->width + 2;
+  int gridRows = entry->height + 2;
+  memset(cells, SPECIAL, (size_t)gridColumns);
+  memset(cells + (size_t)(gridRows-1)*gridColumns, SPECIAL,
+         (size_t)gridColumns);
+  size_t n = 0;
+  int i,j;
+  for(i=1; i<gridRows-1; ++i)
+  { unsigned char* row = cells + (size_t)i*gridColumns;
+    row[0] = SPECIAL;
+    row[gridColumns-1] = SPECIAL;
+    for(j=1; j<gridColumns-1; ++j, ++n)
+    { row[j] = (entry->cells[n/2] >> ((n & 1) * 4)) & ALL_DIRECTIONS;
+      if(i == gridRows-2 && (row[j] & SOUTH))
+      { row[j] |= GOAL;
+      }
+    }
+  }
+}
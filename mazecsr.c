@@ -0,0 +1,209 @@
+/********************************************************************
+* Passage Graph Export
+*
+* Gives the maze's passages as a graph in compressed sparse row form,
+* the layout most graph engines load directly:
+*
+*   vertex v     interior cell (x, y), v = (y-1)*width + (x-1), so
+*                vertices run row by row from the top left
+*   offsets[v]   first entry of v's neighbors in neighbors, with
+*                offsets[vertices] = edges
+*   neighbors    every vertex's neighbors, in DIRECTION_LIST order
+*
+* Each passage shows up twice, once from each end. The entrance and
+* exit openings lead into the border and are not edges.
+*
+* mazeGraphExport fills caller buffers, mazeGraphWrite fills a file
+* through a mapping, and mazeGraphNeighbors reads one vertex's
+* neighbors straight off the wall bits without building anything.
+*
+* Entries are 32 bit, so a maze whose vertex or edge count (or, in a
+* file, whose neighbors' byte offset) does not fit is refused rather
+* than written truncated.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define GRAPH_FILE_MAGIC "MAZECSR"
+#define GRAPH_FILE_VERSION 1
+
+struct graphFileHeader {
+  char magic[8];
+  unsigned int version;
+  unsigned int width, height;
+  unsigned int vertices, edges;
+  unsigned int offsetsStart;    //byte offset of offsets in the file
+  unsigned int neighborsStart;  //byte offset of neighbors in the file
+};
+
+static int cellNeighbors(int row, int col, unsigned int* out);
+static void fillGraph(unsigned int* offsets, unsigned int* neighbors);
+static int graphTooLarge(size_t vertices, size_t edges);
+
+/********************************************************************
+* mazeGraphSize counts the vertices and the neighbor entries (edges,
+* two per passage) of the current maze, for sizing the buffers handed
+* to mazeGraphExport.
+*
+* Returns TRUE if there is no maze.
+********************************************************************/
+int mazeGraphSize(size_t* vertices, size_t* edges)
+{ if(maze == NULL)
+  { printf("ERROR: No maze to export\n");
+    return TRUE;
+  }
+  *vertices = (size_t)(rows-2)*(columns-2);
+  *edges = 0;
+  int i,j;
+  for(i=1; i<rows-1; ++i)
+  { for(j=1; j<columns-1; ++j)
+    { int sides = maze[i][j];
+      if(i == 1) sides &= ~NORTH;
+      if(i == rows-2) sides &= ~SOUTH;
+      *edges += ((sides & NORTH) != 0) + ((sides & EAST) != 0) +
+                ((sides & SOUTH) != 0) + ((sides & WEST) != 0);
+    }
+  }
+  return FALSE;
+}
+
+/********************************************************************
+* mazeGraphExport writes the graph of the current maze into offsets,
+* which holds vertices+1 entries, and neighbors, which holds edges
+* entries, as counted by mazeGraphSize. One pass over the grid, plus
+* a counting pass for mazes big enough that the edges might not fit.
+*
+* Returns TRUE if there is no maze or it is too large for 32 bit
+* entries.
+********************************************************************/
+int mazeGraphExport(unsigned int* offsets, unsigned int* neighbors)
+{ if(maze == NULL)
+  { printf("ERROR: No maze to export\n");
+    return TRUE;
+  }
+  size_t vertices = (size_t)(rows-2)*(columns-2);
+  size_t edges = TOTAL_DIRECTIONS*vertices;
+  if(vertices < UINT_MAX && edges > UINT_MAX)
+  { mazeGraphSize(&vertices, &edges);
+  }
+  if(graphTooLarge(vertices, edges))
+  { return TRUE;
+  }
+  fillGraph(offsets, neighbors);
+  return FALSE;
+}
+
+/********************************************************************
+* mazeGraphWrite writes the graph of the current maze to fileName,
+* filled in place through a shared mapping: a graphFileHeader, then
+* the offsets, then the neighbors, all as 32 bit unsigned ints.
+*
+* Returns TRUE if there is no maze, it is too large for the format or
+* the file cannot be written.
+********************************************************************/
+int mazeGraphWrite(const char* fileName)
+{ size_t vertices, edges;
+  if(mazeGraphSize(&vertices, &edges) || graphTooLarge(vertices, edges))
+  { return TRUE;
+  }
+  if(sizeof(struct graphFileHeader) + (vertices+1)*sizeof(unsigned int) >
+     UINT_MAX)
+  { printf("ERROR: Maze too large for a graph file\n");
+    return TRUE;
+  }
+  struct graphFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GRAPH_FILE_MAGIC, sizeof(GRAPH_FILE_MAGIC));
+  header.version = GRAPH_FILE_VERSION;
+  header.width = (unsigned int)(columns-2);
+  header.height = (unsigned int)(rows-2);
+  header.vertices = (unsigned int)vertices;
+  header.edges = (unsigned int)edges;
+  header.offsetsStart = sizeof(header);
+  header.neighborsStart = sizeof(header) +
+                          (unsigned int)((vertices+1)*sizeof(unsigned int));
+  size_t size = header.neighborsStart + edges*sizeof(unsigned int);
+
+  int fd = open(fileName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0 || ftruncate(fd, (off_t)size) != 0)
+  { printf("ERROR: Could not write %s\n", fileName);
+    if(fd >= 0) close(fd);
+    return TRUE;
+  }
+  unsigned char* base = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                             MAP_SHARED, fd, 0);
+  if(base == MAP_FAILED)
+  { printf("ERROR: Could not write %s\n", fileName);
+    close(fd);
+    return TRUE;
+  }
+  memcpy(base, &header, sizeof(header));
+  fillGraph((unsigned int*)(base + header.offsetsStart),
+            (unsigned int*)(base + header.neighborsStart));
+  int failed = msync(base, size, MS_SYNC) != 0;
+  munmap(base, size);
+  failed |= close(fd) != 0;
+  if(failed)
+  { printf("ERROR: Could not write %s\n", fileName);
+  }
+  return failed;
+}
+
+/********************************************************************
+* mazeGraphNeighbors writes the neighbors of vertex to out, which
+* holds 4 entries, reading the current maze's wall bits directly.
+*
+* Returns the number of neighbors, or -1 if there is no maze or no
+* such vertex.
+********************************************************************/
+int mazeGraphNeighbors(unsigned int vertex, unsigned int* out)
+{ if(maze == NULL || vertex >= (size_t)(rows-2)*(columns-2))
+  { return -1;
+  }
+  return cellNeighbors(vertex/(columns-2) + 1, vertex%(columns-2) + 1, out);
+}
+
+//Neighbors of the cell at row, col as vertex numbers. Returns how many
+static int cellNeighbors(int row, int col, unsigned int* out)
+{ int sides = maze[row][col];
+  if(row == 1) sides &= ~NORTH;
+  if(row == rows-2) sides &= ~SOUTH;
+  unsigned int vertex = (unsigned int)((size_t)(row-1)*(columns-2) + col-1);
+  int count = 0, d;
+  for(d=0; d<TOTAL_DIRECTIONS; ++d)
+  { if(sides & DIRECTION_LIST[d])
+    { out[count++] = vertex + DIRECTION_DY[d]*(columns-2) + DIRECTION_DX[d];
+    }
+  }
+  return count;
+}
+
+//One pass over the grid, appending each cell's neighbors in turn
+static void fillGraph(unsigned int* offsets, unsigned int* neighbors)
+{ unsigned int edges = 0;
+  int i,j;
+  for(i=1; i<rows-1; ++i)
+  { for(j=1; j<columns-1; ++j)
+    { *offsets++ = edges;
+      edges += (unsigned int)cellNeighbors(i, j, neighbors + edges);
+    }
+  }
+  *offsets = edges;
+}
+
+//Returns TRUE, with an ERROR, if offsets or neighbors would overflow
+static int graphTooLarge(size_t vertices, size_t edges)
+{ if(vertices >= UINT_MAX || edges > UINT_MAX)
+  { printf("ERROR: Maze too large for 32 bit graph entries\n");
+    return TRUE;
+  }
+  return FALSE;
+}
@@ -10,9 +10,12 @@
 *   int wayPointX: x coordinate of position that is required to be 
 *               passed through by maze
 *   int wayPointY; same as wayPointX except for y coordinate
-*   int wayPointAlleyLength:         NOT IN USE
-*   double wayPointDirectionPercent: NOT IN USE
-*   double straightProbability:      NOT IN USE
+*   int wayPointAlleyLength: cells in a straight alley without side
+*               passages that leads into the waypoint
+*   double wayPointDirectionPercent: chance that the carve tries the
+*               direction toward the waypoint first
+*   double straightProbability: chance that the carve tries to go
+*               straight on first
 *   int printAlgorithmSteps:         NOT IN USE
 *
 * Functionality:
@@ -28,17 +31,12 @@
 #include <time.h> 
 #include <string.h>
 #include "mazegen.h"
-#include "bmpStruct.h"
-
-#define PIXELS_ON_PIECE_SIDE 8
-#define PIXELS_IN_BLOCK 64
-#define PIXEL_OFFSET 54
-#define BMP_BLOCK_SIZE 246 //in bytes  
-#define COLOR_DEPTH_IN_BYTES 3
+#include "mazeModel.h"
 
 const char* errors[] ={ "ERROR: Invalid width argument",
                         "ERROR: Invalid height argument",
-                        "ERROR: One or more waypoints out of bounds" };
+                        "ERROR: One or more waypoints out of bounds",
+                        "ERROR: Invalid shaping argument" };
 
 const char generalError[] = {"An error has been detected. Program was\n" 
                               "terminated when error was detected. More\n"
@@ -47,20 +45,45 @@ const char generalError[] = {"An error has been detected. Program was\n"
                             };
                              
 
-//Double pointer will represent maze
-static unsigned char** maze;
-static int rows, columns;
-static int wayX, wayY;
-unsigned int** pixelMap;
+//Double pointer will represent maze, rows point into one block
+unsigned char** maze;
+int rows, columns;
+int wayX, wayY;
 static int mazeMallocFlag = FALSE;
+static int mazeMappedFlag = FALSE;
+
+//Cells per band when carving a file backed grid
+#define MAPPED_BAND_CELLS (64*1024*1024)
 
-int carveMaze(int row, int col);
+/* Shaped carving. The chances are turned into thresholds on rand()
+*  once per mazeGenerate, and direction orders come from tables, so a
+*  carve step makes integer compares only. towardThreshold counts the
+*  straight draws too. */
+#define NO_HEADING -1
+#define TOTAL_ORDERS 24      //orders of the 4 directions
+#define ORDERS_PER_LEAD 6    //orders that start with a given direction
+static int shapingFlag = FALSE;
+static unsigned int straightThreshold, towardThreshold;
+static int aimRow, aimCol;
+static int directionIndex[WEST+1];
+static int allOrders[TOTAL_ORDERS][TOTAL_DIRECTIONS];
+static int leadOrders[TOTAL_DIRECTIONS][ORDERS_PER_LEAD][TOTAL_DIRECTIONS];
+
+int carveMaze(int row, int col, int heading);
+static void setupShaping(int wayPointX, int wayPointY,
+                         double wayPointDirectionPercent,
+                         double straightProbability);
+static const int* pickOrder(int row, int col, int heading);
+static int pickOpen(int row, int col, int heading,
+                    const int* open, int count);
+static int towardWayPoint(int row, int col);
+static int makeAlley(int col, int row, int length, int step);
+int carveBands(int wayPointX, int wayPointY);
+void carveInBand(int row, int col, int top, int* stack);
 void makeExits(void);
 void makeWall(int row, int mode);
 void shuffle(int *array, size_t n); //Author of code cited in documentation
 int searchPath(int row, int column);
-void addMazeBlock(int currRow, int currCol);
-void printPixelMap(int rows, int cols);
 
 int mazeGenerate(int width, int height,
                  int wayPointX, int wayPointY,
@@ -68,6 +91,85 @@ int mazeGenerate(int width, int height,
                  double wayPointDirectionPercent,
                  double straightProbability,
                  int printAlgorithmSteps)
+{ 
+  if(wayPointAlleyLength < 0 ||
+     !(wayPointDirectionPercent >= 0.0 && wayPointDirectionPercent <= 1.0) ||
+     !(straightProbability >= 0.0 && straightProbability <= 1.0))
+  { printf("%s\n", errors[3]);
+    printf("%s\n", generalError);
+    return TRUE;
+  }
+  if(setupMaze(width, height, wayPointX, wayPointY))
+  { return TRUE;
+  }
+  setupShaping(wayPointX, wayPointY, wayPointDirectionPercent,
+               straightProbability);
+ 
+  /* If waypoint is above the middle row of the maze, temporarily 
+  * block off cells above the row that the waypoint is in. If the
+  * waypoint is below the middle row of the maze, temporarily
+  * block off the cells below the row that waypoint is in.
+  *
+  * This is so that we can carve out the maze into two parts, 
+  * with the waypoint being the only way inbetween the lower
+  * and upper parts. This forces the solution to go through waypoint
+  */
+  if( mazeMappedFlag )
+  { //File backed grids are carved a band at a time, see carveBands
+    if(carveBands(wayPointX, wayPointY))
+    { mazeFree();
+      return TRUE;
+    }
+  }
+  else if( wayPointY <= (rows-2)/2 )
+  { 
+    makeWall( wayPointY, TRUE );
+    //Carve, past the alley if there is one
+    int alley = makeAlley(wayPointX, wayPointY, wayPointAlleyLength, 1);
+    carveMaze(wayPointY+1+alley, wayPointX, NO_HEADING);
+    if(alley > 0)
+    { maze[wayPointY+1+alley][wayPointX] |= NORTH;
+    }
+    //Unblock section
+    makeWall( wayPointY, FALSE );
+    //Carve the rest
+    carveMaze(wayPointY, wayPointX, NO_HEADING);
+    //Connect cells
+    maze[wayPointY+1][wayPointX] |= NORTH;
+    maze[wayPointY][wayPointX] |= SOUTH;
+  }
+  else
+  {  
+    makeWall( wayPointY, TRUE );
+    //Carve, past the alley if there is one
+    int alley = makeAlley(wayPointX, wayPointY, wayPointAlleyLength, -1);
+    carveMaze(wayPointY-1-alley, wayPointX, NO_HEADING);
+    if(alley > 0)
+    { maze[wayPointY-1-alley][wayPointX] |= SOUTH;
+    }
+    //Unblock section
+    makeWall( wayPointY, FALSE );
+    //Carve the rest
+    carveMaze(wayPointY, wayPointX, NO_HEADING);
+    //Connect cells
+    maze[wayPointY-1][wayPointX] |= SOUTH;
+    maze[wayPointY][wayPointX] |= NORTH;
+  }
+
+  finishMaze(wayPointX, wayPointY);
+  //In the case of proper evaluation
+  return FALSE;
+}
+
+/********************************************************************
+* setupMaze checks the mazeGenerate arguments and sets up a blank
+* grid for them: interior cells NO_DIRECTIONS, border cells SPECIAL.
+* Any previous maze is freed first.
+*
+* Returns TRUE if an argument is out of range or storage could not be
+* made, after printing the error.
+********************************************************************/
+int setupMaze(int width, int height, int wayPointX, int wayPointY)
 { 
   //Free your mallocs! (If we have a previous allocation floating)
   if(mazeMallocFlag)
@@ -99,13 +201,39 @@ int mazeGenerate(int width, int height,
   rows = height + 2 ;
   columns = width + 2 ;
 
-  //Allocate memory for maze
+  //Allocate memory for maze. The cells are one block so the whole
+  //grid can be copied out with a single memcpy. If mazeStorage named
+  //a file, the block is that file mapped into memory instead.
   maze = malloc((rows)*sizeof(unsigned char*));
+  if(maze == NULL)
+  { printf("ERROR: Not enough memory for the maze\n");
+    return TRUE;
+  }
+  if(storageSelected())
+  { *maze = createMappedGrid(rows, columns);
+    if(*maze == NULL)
+    { printf("ERROR: Could not create maze storage file\n");
+      free(maze);
+      maze = NULL;
+      return TRUE;
+    }
+    mazeMappedFlag = TRUE;
+  }
+  else
+  { *maze = malloc((size_t)rows*columns*sizeof(unsigned char));
+    if(*maze == NULL)
+    { printf("ERROR: Not enough memory for the maze\n");
+      free(maze);
+      maze = NULL;
+      return TRUE;
+    }
+  }
   int i,j;
-  for(i=0; i<rows; ++i){
-    *(maze+i) = malloc((columns)*sizeof(unsigned char));
+  for(i=1; i<rows; ++i){
+    *(maze+i) = *maze + (size_t)i*columns;
   }
   mazeMallocFlag = TRUE;
+  adviseRows(0, rows-1, ROWS_SEQUENTIAL);
 
   //Initialize non-buffer entries to 0
   for(i=1; i<rows-1; ++i){
@@ -123,43 +251,18 @@ int mazeGenerate(int width, int height,
   { maze[j][0] = SPECIAL;
     maze[j][columns - 1] = SPECIAL;
   }
- 
-  /* If waypoint is above the middle row of the maze, temporarily 
-  * block off cells above the row that the waypoint is in. If the
-  * waypoint is below the middle row of the maze, temporarily
-  * block off the cells below the row that waypoint is in.
-  *
-  * This is so that we can carve out the maze into two parts, 
-  * with the waypoint being the only way inbetween the lower
-  * and upper parts. This forces the solution to go through waypoint
-  */
-  makeWall( wayPointY, TRUE );
-  if( wayPointY <= (rows-2)/2 )
-  { 
-    //Carve
-    carveMaze(wayPointY+1, wayPointX);
-    //Unblock section
-    makeWall( wayPointY, FALSE );
-    //Carve the rest
-    carveMaze(wayPointY, wayPointX);
-    //Connect cells
-    maze[wayPointY+1][wayPointX] |= NORTH;
-    maze[wayPointY][wayPointX] |= SOUTH;
-  }
-  else
-  {  
-    //Carve
-    carveMaze(wayPointY-1, wayPointX);
-    //Unblock section
-    makeWall( wayPointY, FALSE );
-    //Carve the rest
-    carveMaze(wayPointY, wayPointX);
-    //Connect cells
-    maze[wayPointY-1][wayPointX] |= SOUTH;
-    maze[wayPointY][wayPointX] |= NORTH;
-  }
+  return FALSE;
+}
 
+/********************************************************************
+* finishMaze turns a fully carved grid into a finished maze: clears
+* the VISITED marks left by carving, makes the exits and records the
+* waypoint.
+********************************************************************/
+void finishMaze(int wayPointX, int wayPointY)
+{ int i,j;
   //Clear out VISITED spots or any other anomalies
+  adviseRows(0, rows-1, ROWS_SEQUENTIAL);
   for(i=1; i<rows-1; ++i)
   { for(j=1; j<columns-1; ++j)
     { maze[i][j] &= ALL_DIRECTIONS;
@@ -170,7 +273,38 @@ int mazeGenerate(int width, int height,
   //make global waypoint accessible to print(sloppy fix)
   wayX = wayPointX;
   wayY = wayPointY;
-  //In the case of proper evaluation
+  finishMappedGrid();
+}
+
+/********************************************************************
+* mazeOpen makes the maze kept in fileName by an earlier mazeGenerate
+* (after mazeStorage) the current maze again, without regenerating.
+* The file stays mapped until the next mazeGenerate, mazeOpen or
+* mazeFree, and mazeSolve marks are written back to it.
+*
+* Returns TRUE if the file is not a complete maze file.
+********************************************************************/
+int mazeOpen(const char* fileName)
+{ if(mazeMallocFlag)
+  { mazeFree();
+  }
+  unsigned char* cells = openMappedGrid(fileName);
+  if(cells == NULL)
+  { printf("ERROR: %s is not a maze file\n", fileName);
+    return TRUE;
+  }
+  maze = malloc((rows)*sizeof(unsigned char*));
+  if(maze == NULL)
+  { printf("ERROR: Not enough memory to open %s\n", fileName);
+    releaseMappedGrid();
+    return TRUE;
+  }
+  int i;
+  for(i=0; i<rows; ++i)
+  { *(maze+i) = cells + (size_t)i*columns;
+  }
+  mazeMallocFlag = TRUE;
+  mazeMappedFlag = TRUE;
   return FALSE;
 }
 
@@ -181,14 +315,20 @@ int mazeGenerate(int width, int height,
 ********************************************************************/
 void mazeFree(void)
 { 
-  int i; 
   if(mazeMallocFlag){
-    for(i=0; i<rows; ++i)
-    { free( *(maze+i) );
+    if(mazeMappedFlag)
+    { releaseMappedGrid();
+    }
+    else
+    { free( *maze );
     }
     free( maze );
+    maze = NULL;
   }
+  mazeMappedFlag = FALSE;
   mazeMallocFlag = FALSE;
+  releaseDirty();
+  releaseIndex();
 }
 
 /********************************************************************
@@ -224,120 +364,28 @@ void mazePrint(void)
   maze[wayY][wayX] &= (~SPECIAL);
   */
   
-  //Allocate memory for buffer array
-  //Has dimensions of (height*8)*(width*8)
-  int i,j;
-  int pixelMapRows = (rows-2)*PIXELS_ON_PIECE_SIDE;
-  int pixelMapCols = (columns-2)*PIXELS_ON_PIECE_SIDE;
-  pixelMap = malloc( pixelMapRows*sizeof(unsigned int*) );
-  for(i=0; i<pixelMapRows; ++i)
-  { *(pixelMap+i) = malloc(pixelMapCols*sizeof(unsigned int));
-  }
- 
-  /*Begin walking through and building up bitmap piece by piece, and 
-  * we can get a header on the map with our handy dandy header functions
-  * that I made in bmpStruct.c */
-
-  //Write pixelMap
-  for(i=1; i<rows-1; ++i)
-  {
-    for(j=1; j<columns-1; ++j)
-    { 
-      addMazeBlock(i, j);
-    }
+  //Build the whole file in memory, then hand it to the OS in one write
+  size_t imageSize;
+  unsigned char* image = mazeRender(&imageSize);
+  if(image == NULL)
+  { return;
   }
 
-  //WRITE HEADER
-  //24 bit color depth 
-  struct headerBMP header;
-  makeSimpleHeader(&header, pixelMapCols, pixelMapRows, 24);
   FILE* bmpPixelMap = fopen("maze.bmp", "wb");
-  writeHeader(bmpPixelMap, &header);
-  printf("WROTE HEADER\n");
-  
-  //WRITE FROM PIXELMAP TO IMAGE FILE
-  //currently the data is stored in integers in pixelMap 
-  unsigned char tempArr[4];
-  for(i=pixelMapRows-1; i>=0; --i)
-  { for(j=0; j<pixelMapCols; ++j)
-    { intToCharArr(pixelMap[i][j], tempArr);
-      fwrite(tempArr ,sizeof(unsigned char),COLOR_DEPTH_IN_BYTES,bmpPixelMap); 
-    }
+  if(bmpPixelMap == NULL)
+  { printf("ERROR: Could not open maze.bmp for writing\n");
+    free(image);
+    return;
   }
+  fwrite(image, sizeof(unsigned char), PIXEL_OFFSET, bmpPixelMap);
+  printf("WROTE HEADER\n");
+  fwrite(image + PIXEL_OFFSET, sizeof(unsigned char), 
+         imageSize - PIXEL_OFFSET, bmpPixelMap);
   printf("WROTE DATA\n");
   
-  //FREE PIXELMAP AND CLOSE FILE
   fclose(bmpPixelMap);
-
-  for(i=0; i<pixelMapCols; ++i)
-  { free( *(pixelMap+i) );
-  }
-  free( pixelMap );
- 
+  free(image);
 } 
-/********************************************************************
-* addMazeBlock adds to the pixel map buffer the 8x8 bitmap associated
-* with the piece currently being looped over in print maze. This will
-* pull the pixel map data from the piece and add it to the larger 
-* full maze pixel map.
-*
-* Params:
-*   i,j: location of piece to be copied into bit map (row, column)
-* No Returns
-********************************************************************/
-void addMazeBlock(int i, int j)
-{ char temp = maze[i][j] & ALL_DIRECTIONS;
-  char baseFileName[] = "mazeBitMap";
-  char endFileName[] = ".bmp";
-  char* fileNum;
-  if(temp>9)
-  { fileNum = malloc( sizeof(char)*3 );
-    *fileNum = '1';
-    *(fileNum+1) = temp - 10 + 48;
-    *(fileNum+2) = '\0';
-  }
-  else
-  { fileNum = malloc( sizeof(char)*2 );
-    *fileNum = temp + 48;
-    *(fileNum+1) = '\0';
-  }
-  char* fileName= strcat(strcat(baseFileName, fileNum),endFileName);
-  FILE* mazeBlock = fopen(fileName, "rb");
-  /* Verify proper file names test
-  printf("%s\n", fileName); 
-  */
-  free(fileNum);
-  
-  //LOAD BUFFER WITH MAZE BLOCK FILE (.bmp file)
-  int k,m,p;
-  unsigned char mazeBlockBuffer[BMP_BLOCK_SIZE];
-  fread(mazeBlockBuffer, sizeof(unsigned char), BMP_BLOCK_SIZE, mazeBlock);
-  fclose(mazeBlock);
-  
-  /* Print Buffer Contents
-  for(k=0; k<BMP_BLOCK_SIZE; ++k)
-  { printf("%02x", mazeBlockBuffer[k]);
-  }
-  printf("\n");
-  */
- 
-  //MOVE FROM BUFFER TO PIXELMAP 
-  unsigned int rgbInfo = 0;
-  unsigned char tempArr[4];
-  unsigned char* offsetPtr = &mazeBlockBuffer[PIXEL_OFFSET];
-  for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
-  { for(m=0; m<PIXELS_ON_PIECE_SIDE; ++m)
-    { for(p=0; p<COLOR_DEPTH_IN_BYTES; ++p)
-      { rgbInfo |= ( ( (unsigned int)*(offsetPtr+p) ) << (8*p) );
-      }
-      //printf("k=%d, m=%d\n",k,m);
-      pixelMap[PIXELS_ON_PIECE_SIDE*i - k - 1][PIXELS_ON_PIECE_SIDE*(j-1) + m] = rgbInfo;
-      rgbInfo = 0;
-      offsetPtr += COLOR_DEPTH_IN_BYTES;
-    }
-  }
-
-}
 
 /********************************************************************
 * carveMaze is a recursive function that will be used to generate
@@ -349,23 +397,32 @@ void addMazeBlock(int i, int j)
 *   int row, col : row and col constitute the indecies for the 
 *   current location of the function call in the maze. Initial
 *   row and col should correspond to waypoints x and y 
+*   int heading : index of the direction taken into this cell, or
+*   NO_HEADING for the first cell. Only shaped carving looks at it
 * Return:
 *   TRUE: if it was possible to carve a path at the point specified
 *   FALSE: if it was not possible to carve even a path of length 1
 ********************************************************************/
-int carveMaze(int row, int col)
+int carveMaze(int row, int col, int heading)
 { 
   if( maze[row][col] != NO_DIRECTIONS )
   { return FALSE;
   }
   //Scramble maze directions and store
-  int order[] = {0, 1, 2, 3};
-  shuffle(order, TOTAL_DIRECTIONS); 
+  int scrambled[] = {0, 1, 2, 3};
+  const int* order = scrambled;
+  if( shapingFlag )
+  { order = pickOrder(row, col, heading);
+  }
+  else
+  { shuffle(scrambled, TOTAL_DIRECTIONS); 
+  }
   maze[row][col] = VISITED;
   int i;
   for(i=0; i<TOTAL_DIRECTIONS; ++i)
   { //Look each direction in order specified by 'order'
-    if( carveMaze(row + DIRECTION_DY[order[i]], col + DIRECTION_DX[order[i]]) )
+    if( carveMaze(row + DIRECTION_DY[order[i]], col + DIRECTION_DX[order[i]],
+                  order[i]) )
     {
       maze[row][col] |= DIRECTION_LIST[order[i]];
       if(DIRECTION_LIST[order[i]] >= SOUTH )
@@ -404,6 +461,238 @@ int carveMaze(int row, int col)
   return TRUE;
 }
 
+/********************************************************************
+* carveBands carves a file backed maze one horizontal band of rows at
+* a time, so only about one band of the grid has to be in memory. It
+* is the waypoint trick from mazeGenerate repeated: the row below the
+* band is walled off with makeWall while the band is carved, and each
+* band joins the band above it through exactly one passage. The bands
+* form a chain from the entrance row to the exit row, so the solution
+* crosses every joining passage, and the band boundary next to the
+* waypoint is placed so its joining passage starts at the waypoint.
+*
+* Params:
+*   wayPointX, wayPointY: waypoint column and row
+*
+* Returns TRUE if there is no memory for the band's stack, after
+* printing the error. Otherwise FALSE.
+********************************************************************/
+int carveBands(int wayPointX, int wayPointY)
+{ int bandRows = MAPPED_BAND_CELLS / columns;
+  if(bandRows < 1)
+  { bandRows = 1;
+  }
+  //A maze shorter than one band only needs a stack for its own rows
+  if(bandRows > rows-2)
+  { bandRows = rows-2;
+  }
+  //Bands split between cutRow and cutRow+1, joined at the waypoint
+  int cutRow = (wayPointY < rows-2) ? wayPointY : wayPointY-1;
+  int* stack = malloc((size_t)bandRows*columns*sizeof(int));
+  if(stack == NULL)
+  { printf("ERROR: Not enough memory to carve a band of the maze\n");
+    return TRUE;
+  }
+
+  int top = 1;
+  while(top <= rows-2)
+  { int bottom = top + bandRows - 1;
+    if(bottom > rows-2)
+    { bottom = rows-2;
+    }
+    if(top <= cutRow && cutRow < bottom)
+    { bottom = cutRow;
+    }
+    adviseRows(top-1, bottom+1, ROWS_NEEDED);
+    if(bottom < rows-2)
+    { makeWall(bottom+1, TRUE);
+    }
+
+    //The band above ends on cutRow when this band starts after it
+    int column = (top == cutRow+1) ? wayPointX
+                                   : (int)(rand()%(columns-2) + 1);
+    carveInBand(top, column, top, stack);
+    if(top > 1)
+    { maze[top-1][column] |= SOUTH;
+      maze[top][column] |= NORTH;
+    }
+
+    if(bottom < rows-2)
+    { makeWall(bottom+1, FALSE);
+    }
+    //Keep the last row, the next band joins onto it
+    adviseRows(top-1, bottom-1, ROWS_DONE);
+    top = bottom + 1;
+  }
+  free(stack);
+  return FALSE;
+}
+
+/********************************************************************
+* carveInBand is carveMaze without recursion, for bands too large for
+* the call stack. Each step picks a random uncarved neighbor of the
+* cell on top of the stack, or backs up if there is none. Cells are
+* kept on the stack by their offset from the band's top row.
+*
+* Params:
+*   row, col: starting cell
+*   top: first row of the band
+*   stack: room for one entry per cell of the band
+********************************************************************/
+void carveInBand(int row, int col, int top, int* stack)
+{ int depth = 0, heading = NO_HEADING;
+  maze[row][col] = VISITED;
+  stack[depth++] = (row-top)*columns + col;
+  while(depth > 0)
+  { int cell = stack[depth-1];
+    row = cell/columns + top;
+    col = cell%columns;
+    int open[TOTAL_DIRECTIONS];
+    int count = 0, i;
+    for(i=0; i<TOTAL_DIRECTIONS; ++i)
+    { if(maze[row + DIRECTION_DY[i]][col + DIRECTION_DX[i]] == NO_DIRECTIONS)
+      { open[count++] = i;
+      }
+    }
+    if(count == 0)
+    { --depth;
+      heading = NO_HEADING;
+      continue;
+    }
+    i = shapingFlag ? pickOpen(row, col, heading, open, count)
+                    : open[rand()%count];
+    heading = i;
+    int nextRow = row + DIRECTION_DY[i], nextCol = col + DIRECTION_DX[i];
+    maze[row][col] |= DIRECTION_LIST[i];
+    if(DIRECTION_LIST[i] >= SOUTH)
+    { maze[nextRow][nextCol] = VISITED | (DIRECTION_LIST[i]>>2);
+    }
+    else
+    { maze[nextRow][nextCol] = VISITED | (DIRECTION_LIST[i]<<2);
+    }
+    stack[depth++] = (nextRow-top)*columns + nextCol;
+  }
+}
+
+/********************************************************************
+* setupShaping prepares shaped carving for one mazeGenerate call. The
+* two chances become thresholds that rand() is compared against, and
+* the tables hold every order of the four directions, all together
+* and grouped by the direction they start with. With both chances 0
+* shaping stays off and the carve is the plain one, so a seed carves
+* the same maze as before.
+*
+* Params:
+*   wayPointX, wayPointY: waypoint column and row, to aim at
+*   wayPointDirectionPercent, straightProbability: [0.0, 1.0]
+********************************************************************/
+static void setupShaping(int wayPointX, int wayPointY,
+                         double wayPointDirectionPercent,
+                         double straightProbability)
+{ double toward = straightProbability +
+                  (1.0 - straightProbability)*wayPointDirectionPercent;
+  straightThreshold = (unsigned int)(straightProbability*(RAND_MAX + 1.0));
+  towardThreshold = (unsigned int)(toward*(RAND_MAX + 1.0));
+  shapingFlag = (towardThreshold > 0);
+  aimRow = wayPointY;
+  aimCol = wayPointX;
+
+  int d, count = 0, leads[TOTAL_DIRECTIONS] = {0};
+  for(d=0; d<TOTAL_DIRECTIONS; ++d)
+  { directionIndex[DIRECTION_LIST[d]] = d;
+  }
+  //Every 4 digit number in base 4 with no digit twice, in order
+  int code;
+  for(code=0; code<TOTAL_DIRECTIONS*TOTAL_DIRECTIONS*
+                   TOTAL_DIRECTIONS*TOTAL_DIRECTIONS; ++code)
+  { int digits[TOTAL_DIRECTIONS], used = 0, rest = code;
+    for(d=TOTAL_DIRECTIONS-1; d>=0; --d)
+    { digits[d] = rest % TOTAL_DIRECTIONS;
+      rest /= TOTAL_DIRECTIONS;
+      used |= 1 << digits[d];
+    }
+    if(used != (1 << TOTAL_DIRECTIONS) - 1)
+    { continue;
+    }
+    memcpy(allOrders[count++], digits, sizeof(digits));
+    memcpy(leadOrders[digits[0]][leads[digits[0]]++], digits, sizeof(digits));
+  }
+}
+
+/********************************************************************
+* pickOrder takes the place of shuffle when carving is shaped. One
+* draw decides: below straightThreshold the order starts with the
+* heading, below towardThreshold with the direction of the waypoint,
+* and otherwise any order will do. A second draw picks the order from
+* the tables.
+********************************************************************/
+static const int* pickOrder(int row, int col, int heading)
+{ unsigned int draw = (unsigned int)rand();
+  int lead = NO_HEADING;
+  if(draw < straightThreshold)
+  { lead = heading;
+  }
+  if(lead == NO_HEADING && draw < towardThreshold)
+  { lead = towardWayPoint(row, col);
+  }
+  if(lead == NO_HEADING)
+  { return allOrders[rand() / (RAND_MAX/TOTAL_ORDERS + 1)];
+  }
+  return leadOrders[lead][rand() / (RAND_MAX/ORDERS_PER_LEAD + 1)];
+}
+
+//pickOrder for carveInBand: the chosen direction if it is open, or any
+static int pickOpen(int row, int col, int heading,
+                    const int* open, int count)
+{ unsigned int draw = (unsigned int)rand();
+  int lead = NO_HEADING, i;
+  if(draw < straightThreshold)
+  { lead = heading;
+  }
+  if(lead == NO_HEADING && draw < towardThreshold)
+  { lead = towardWayPoint(row, col);
+  }
+  for(i=0; i<count; ++i)
+  { if(open[i] == lead) return lead;
+  }
+  return open[rand()%count];
+}
+
+//Index of the direction that closes most of the way to the waypoint
+static int towardWayPoint(int row, int col)
+{ int dx = aimCol - col, dy = aimRow - row;
+  if(dx == 0 && dy == 0)
+  { return NO_HEADING;
+  }
+  if(abs(dy) >= abs(dx))
+  { return directionIndex[dy < 0 ? NORTH : SOUTH];
+  }
+  return directionIndex[dx > 0 ? EAST : WEST];
+}
+
+/********************************************************************
+* makeAlley lays a straight alley of up to length cells in the
+* waypoint's column, going away from the waypoint a row at a time
+* (step 1 for down, -1 for up). The alley cells are VISITED, so the
+* carve goes around them and they get no side passages. The carve then
+* starts in the cell just past the alley, which the caller joins to
+* it. The alley stops at least one row short of the edge, so the carve
+* can still get around it to both sides.
+*
+* Returns the number of alley cells laid.
+********************************************************************/
+static int makeAlley(int col, int row, int length, int step)
+{ int room = (step > 0) ? rows-3-row : row-2;
+  if(length > room)
+  { length = room;
+  }
+  int i;
+  for(i=1; i<=length; ++i)
+  { maze[row + i*step][col] = VISITED | NORTH | SOUTH;
+  }
+  return length > 0 ? length : 0;
+}
+
 /********************************************************************
 * shuffle will mix up the elements of an array. 
 *
@@ -495,16 +784,21 @@ void mazeSolve ()
 
 /********************************************************************
 * searchPath implements a direct solver for the maze. 
-* Uses a recursive method very similar to the maze
+* Uses a depth first search very similar to the maze
 * carving algorithm. Using a direct solver so that I could also solve
 * unknown mazes. The solution will be stored in the maze model by 
 * marking solution cells with the GOAL bit. 
 *
+* The search keeps its own stack of one byte per step instead of
+* recursing, so the length of the path is not limited by the call
+* stack on very large mazes.
+*
 * Params:
-*   int row, col: current row and column
+*   int row, col: starting row and column
 *
 * Returns:
-*   TRUE if returning from solution, returns FALSE otherwise
+*   TRUE if a solution was found, returns FALSE otherwise, also when
+*   there is no memory for the stack (after printing the error)
 ********************************************************************/
 int searchPath( int row, int col ) {
   //Makes calls predetermined order, no need to be random here
@@ -515,18 +809,71 @@ int searchPath( int row, int col ) {
   if( maze[row][col] & GOAL )
   { return TRUE; 
   }
-  //Look WEST, SOUTH, EAST, then NORTH
-  int i;
-  for(i=TOTAL_DIRECTIONS-1; i>=0; --i)
-  {
-    if( maze[row][col] & DIRECTION_LIST[i] )
-    { if( searchPath(row + DIRECTION_DY[i], col + DIRECTION_DX[i] ) )
-      { maze[row][col] |= GOAL;
-        return TRUE;  
+  /* left[k]: directions still to look at from the cell at depth k
+  *  came[k]: index of the direction taken into the cell at depth k */
+  size_t capacity = 1024, depth = 0;
+  unsigned char* left = malloc(capacity);
+  unsigned char* came = malloc(capacity);
+  int found = FALSE;
+  if( left == NULL || came == NULL )
+  { printf("ERROR: Not enough memory to solve the maze\n");
+    free(left);
+    free(came);
+    return FALSE;
+  }
+  left[0] = TOTAL_DIRECTIONS;
+  while( !found )
+  { if( left[depth] == 0 )
+    { //Dead end, back up
+      if( depth == 0 ) break;
+      row -= DIRECTION_DY[came[depth]];
+      col -= DIRECTION_DX[came[depth]];
+      --depth;
+      continue;
+    }
+    //Look WEST, SOUTH, EAST, then NORTH
+    int i = --left[depth];
+    if( !(maze[row][col] & DIRECTION_LIST[i]) )
+    { continue;
+    }
+    int nextRow = row + DIRECTION_DY[i], nextCol = col + DIRECTION_DX[i];
+    if( maze[nextRow][nextCol] & (SPECIAL|VISITED) )
+    { continue;
+    }
+    maze[nextRow][nextCol] |= VISITED;
+    if( depth+1 == capacity )
+    { unsigned char* moreLeft = realloc(left, 2*capacity);
+      if( moreLeft != NULL ) left = moreLeft;
+      unsigned char* moreCame = realloc(came, 2*capacity);
+      if( moreCame != NULL ) came = moreCame;
+      if( moreLeft == NULL || moreCame == NULL )
+      { printf("ERROR: Not enough memory to solve the maze\n");
+        break;
       }
+      capacity *= 2;
+    }
+    ++depth;
+    left[depth] = TOTAL_DIRECTIONS;
+    came[depth] = (unsigned char)i;
+    row = nextRow;
+    col = nextCol;
+    found = (maze[row][col] & GOAL) != 0;
+  }
+  //Mark the way back from the goal, which is now visited too
+  if( found )
+  { markDirty(row, col);
+    while( depth > 0 )
+    { row -= DIRECTION_DY[came[depth]];
+      col -= DIRECTION_DX[came[depth]];
+      maze[row][col] |= GOAL;
+      markDirty(row, col);
+      --depth;
     }
   }
-  
+  free(left);
+  free(came);
+  return found;
+
   //Simpler to read 'copy paste' code
   /*
   if( (maze[row][col] & SOUTH) )
@@ -557,6 +904,5 @@ int searchPath( int row, int col ) {
     }
   }
   */
-  return FALSE; 
 }
 
@@ -1,6 +1,8 @@
 #ifndef MAZEGEN_H
 #define MAZEGEN_H
 
+#include <stddef.h>
+
 #define TRUE 1
 #define FALSE 0
 
@@ -39,6 +41,12 @@ extern const int DIRECTION_DY[];
 extern const unsigned char pipeList[];
 
 
+//mazeGenerate carves by recursion, one call per cell. A thread that 
+//  calls it needs this much stack per cell of the maze, and at least
+//  MAZE_STACK_MINIMUM.
+#define MAZE_STACK_PER_CELL 128
+#define MAZE_STACK_MINIMUM (8*1024*1024)
+
 //=======================================================================
 //Returns TRUE if one or more parameters are out of range. 
 //  Otherwise, returns FALSE. 
@@ -60,4 +68,178 @@ void mazePrint();
 
 void mazeFree();
 
+//=======================================================================
+//Generates count mazes and writes maze i to the file named by 
+//  printf(namePattern, i). Carving, rendering and file writes run as a
+//  pipeline with renderThreads render workers and queues holding
+//  queueDepth mazes. Returns TRUE on invalid arguments, or if any maze
+//  could not be made or written; the others are still made.
+int mazeBatch(int count, int width, int height,
+    int wayPointX, int wayPointY,
+    int renderThreads, int queueDepth,   // [1, ...], [1, ...]
+    const char* namePattern);            // e.g. "maze%04d.bmp"
+//=======================================================================
+
+//=======================================================================
+//Writes the current maze as a pyramid of tilePixels square bmp tiles,
+//  <directory>/<level>/<x>/<y>.bmp. Level 0 is full resolution and each
+//  level after it is half the size. Tiles are written by threads 
+//  threads. Returns TRUE on invalid arguments, too little memory or 
+//  write errors.
+int mazePyramid(const char* directory, 
+    int tilePixels,                      // multiple of 8
+    int threads);                        // [1, ...]
+//=======================================================================
+
+#define MAZE_CORRIDOR_BINS 32
+
+struct mazeStats {
+  int solutionLength;  //cells from entrance to exit, both included
+  int wayPointIndex;   //place of the waypoint on the solution, entrance 0
+  int turns;           //changes of direction along the solution
+  int deadEnds;        //cells with one open side
+  int diameter;        //cells on the longest path in the maze
+  int branching[TOTAL_DIRECTIONS+1];  //cells by number of open sides
+  int corridors[MAZE_CORRIDOR_BINS];  //corridors by length in steps,
+                                      //  the last bin holds longer ones
+};
+
+//=======================================================================
+//Fills stats for the current maze in one pass over the grid and two
+//  breadth first searches. Returns TRUE if there is no maze.
+int mazeAnalyze(struct mazeStats* stats);
+//=======================================================================
+
+#define MAZE_INVALID_NO_MAZE     1  //no maze has been generated
+#define MAZE_INVALID_ASYMMETRIC  2  //passage open from one side only
+#define MAZE_INVALID_BORDER      4  //opening into the border besides
+                                    //  one entrance and one exit
+#define MAZE_INVALID_CYCLE       8  //passages form a loop
+#define MAZE_INVALID_UNREACHABLE 16 //some cells are cut off
+#define MAZE_INVALID_WAYPOINT    32 //solution skips the waypoint
+#define MAZE_INVALID_NO_MEMORY   64 //not enough memory to check
+
+//=======================================================================
+//Checks the current maze in linear time. Returns FALSE if it is a
+//  valid perfect maze through the waypoint, otherwise the 
+//  MAZE_INVALID_* bits for every problem found.
+int mazeValidate(void);
+//=======================================================================
+
+//=======================================================================
+//Keeps the grid of every following mazeGenerate in a memory mapped 
+//  file, for mazes larger than memory, or on the heap again if 
+//  fileName is NULL. Such mazes are carved in bands of rows so only 
+//  about one band needs to be in memory at a time.
+void mazeStorage(const char* fileName);
+
+//Makes a maze file written by an earlier mazeGenerate the current
+//  maze without regenerating it. Returns TRUE if it is not a maze file.
+int mazeOpen(const char* fileName);
+//=======================================================================
+
+//=======================================================================
+//Same as mazeGenerate (without the shaping arguments), but the
+//  maze is carved by threads threads at once on the shared grid.
+//  Returns TRUE if one or more parameters are out of range or there 
+//  is not enough memory.
+int mazeGenerateParallel(int width, int height,
+    int wayPointX, int wayPointY,
+    int threads);                        // [1, ...]
+//=======================================================================
+
+//=======================================================================
+//Renders the current maze, solution and waypoint included, as a bmp
+//  file image in a new buffer the caller frees. Returns NULL if there
+//  is no maze.
+unsigned char* mazeRender(size_t* imageSize);
+
+//Redraw only the cells changed since the last full render (by 
+//  mazeSolve, for one) in an image from mazeRender, or in a file from
+//  mazePrint. mazePrintChanges returns TRUE if the file cannot be 
+//  written or is not an image of this maze.
+void mazeRenderChanges(unsigned char* image);
+int mazePrintChanges(const char* fileName);  // e.g. "maze.bmp"
+//=======================================================================
+
+struct mazeCacheStats {
+  unsigned long hits, misses;            //mazeGenerateCached lookups
+  unsigned long imageHits, imageMisses;  //mazeRenderCached lookups
+  unsigned long evictions;               //entries dropped for room
+  size_t entries;                        //mazes held now
+  size_t bytes;                          //bytes held now
+};
+
+//=======================================================================
+//Sets the byte budget of the maze cache (0 turns it off) and whether 
+//  rendered images are kept too. Resets the counters.
+void mazeCacheSetup(size_t budget, int storeImages);
+
+//Same maze as srand(seed) then mazeGenerate(width, height, wayPointX, 
+//  wayPointY, ...), taken from the cache when it is there.
+//  Returns TRUE if one or more parameters are out of range.
+int mazeGenerateCached(int width, int height,
+    int wayPointX, int wayPointY, unsigned int seed);
+
+//Bmp image of that maze, unsolved, in a new buffer the caller frees.
+//  Returns NULL if one or more parameters are out of range or there 
+//  is not enough memory.
+unsigned char* mazeRenderCached(int width, int height,
+    int wayPointX, int wayPointY, unsigned int seed, size_t* imageSize);
+
+void mazeCacheCounters(struct mazeCacheStats* stats);
+//=======================================================================
+
+//=======================================================================
+//Builds the path index of the current maze, a tree rooted at the 
+//  entrance. Returns TRUE if there is no maze. Needed by the two below
+//  and dropped with the maze.
+int mazeIndex(void);
+
+//Steps on the path between two cells, in O(log n). -1 if no index or
+//  a cell is outside the maze.
+int mazeDistance(int x1, int y1, int x2, int y2);
+
+//Writes the cells of the path between two cells, both included, if it
+//  has at most maxCells cells. Returns its number of cells, or -1.
+int mazePath(int x1, int y1, int x2, int y2,
+    int* pathX, int* pathY, int maxCells);
+//=======================================================================
+
+//=======================================================================
+//The passages of the current maze as a graph in compressed sparse row
+//  form. Vertex v is cell (v%width + 1, v/width + 1), and the neighbors
+//  of v are neighbors[offsets[v]] up to neighbors[offsets[v+1]]. Each 
+//  returns TRUE if there is no maze (or the file cannot be written).
+//  Export and Write also return TRUE if the counts or file offsets do
+//  not fit in 32 bits.
+int mazeGraphSize(size_t* vertices, size_t* edges);
+int mazeGraphExport(unsigned int* offsets,   // vertices+1 entries
+    unsigned int* neighbors);                // edges entries
+int mazeGraphWrite(const char* fileName);
+
+//Neighbors of one vertex read straight from the walls, into out[4].
+//  Returns how many, or -1 for no maze or no such vertex.
+int mazeGraphNeighbors(unsigned int vertex, unsigned int* out);
+//=======================================================================
+
+//=======================================================================
+//Renders the w by h cells from (x0, y0) as a bmp file image in a new 
+//  buffer the caller frees, with cellPixels of floor per cell and 
+//  walls wallPixels thick, drawn straight from the direction bits.
+//  Returns NULL if there is no maze or an argument is out of range.
+unsigned char* mazeRenderWindow(int x0, int y0, int w, int h,
+    int cellPixels, int wallPixels,      // [1, ...], [1, ...]
+    size_t* imageSize);
+//=======================================================================
+
+//=======================================================================
+//Clears and re-carves the w by h cells from (x0, y0), keeping every
+//  passage across the edge of the rectangle, so the maze stays perfect
+//  and its solution still goes through the waypoint. Takes time in 
+//  proportion to w*h. Returns TRUE if there is no maze or the rectangle
+//  is out of range.
+int mazeRecarve(int x0, int y0, int w, int h);
+//=======================================================================
+
 #endif
@@ -0,0 +1,220 @@
+/********************************************************************
+* Maze Server Load Generator
+*
+* Usage: mazeload socketPath clients requests width height [image]
+*
+* Opens clients connections to a running mazeserver and has each send
+* requests MAZE (or IMAGE) requests for width by height mazes, one at
+* a time. Prints the throughput over all clients and the latency of a
+* single request at a few percentiles, then the server's STATS.
+********************************************************************/
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define TRUE 1
+#define FALSE 0
+
+struct client {
+  const char* socketPath;
+  char request[64];
+  int requests;
+  double* latency;   //seconds per request
+  size_t bytes;      //payload bytes received
+  int failed;
+};
+
+static double now(void);
+static int connectServer(const char* socketPath);
+static int ask(int fd, const char* request, unsigned char** data,
+               size_t* size);
+static int readAll(int fd, unsigned char* buffer, size_t size);
+static int compareDouble(const void* a, const void* b);
+static void* runClient(void* arg);
+
+
+int main(int argc, char** argv)
+{ if(argc < 6)
+  { printf("Usage: %s socketPath clients requests width height [image]\n",
+           argv[0]);
+    return TRUE;
+  }
+  int clients = atoi(argv[2]);
+  int requests = atoi(argv[3]);
+  int width = atoi(argv[4]);
+  int height = atoi(argv[5]);
+  int image = (argc > 6 && strcmp(argv[6], "image") == 0);
+  if(clients < 1 || requests < 1)
+  { printf("ERROR: clients and requests must be at least 1\n");
+    return TRUE;
+  }
+
+  struct client* all = calloc((size_t)clients, sizeof(struct client));
+  pthread_t* threads = malloc((size_t)clients*sizeof(pthread_t));
+  int c;
+  for(c=0; c<clients; ++c)
+  { all[c].socketPath = argv[1];
+    snprintf(all[c].request, sizeof(all[c].request), "%s %d %d\n",
+             image ? "IMAGE" : "MAZE", width, height);
+    all[c].requests = requests;
+    all[c].latency = malloc((size_t)requests*sizeof(double));
+  }
+
+  double start = now();
+  int started;
+  for(started=0; started<clients; ++started)
+  { if(pthread_create(&threads[started], NULL, runClient, &all[started]) != 0)
+    { break;
+    }
+  }
+  for(c=0; c<started; ++c)
+  { pthread_join(threads[c], NULL);
+  }
+  double elapsed = now() - start;
+
+  //Pool every request's latency to take percentiles
+  size_t total = 0, bytes = 0;
+  double* latency = malloc((size_t)clients*requests*sizeof(double));
+  int failures = 0;
+  for(c=0; c<started; ++c)
+  { if(all[c].failed)
+    { ++failures;
+      continue;
+    }
+    memcpy(latency + total, all[c].latency, (size_t)requests*sizeof(double));
+    total += (size_t)requests;
+    bytes += all[c].bytes;
+  }
+  if(total == 0)
+  { printf("ERROR: No requests completed\n");
+    return TRUE;
+  }
+  qsort(latency, total, sizeof(double), compareDouble);
+  printf("%zu requests by %d clients in %.3f s (%d failed)\n",
+         total, started, elapsed, failures + clients - started);
+  printf("throughput %.1f requests/s, %.1f MB/s\n",
+         total / elapsed, bytes / elapsed / 1e6);
+  printf("latency ms  p50 %.3f  p90 %.3f  p99 %.3f  max %.3f\n",
+         1e3*latency[total/2], 1e3*latency[total*9/10],
+         1e3*latency[total*99/100], 1e3*latency[total-1]);
+
+  int fd = connectServer(argv[1]);
+  unsigned char* text;
+  size_t size;
+  if(fd >= 0 && ask(fd, "STATS\n", &text, &size) == FALSE)
+  { printf("server:\n%.*s", (int)size, (char*)text);
+    free(text);
+  }
+  if(fd >= 0) close(fd);
+
+  for(c=0; c<clients; ++c)
+  { free(all[c].latency);
+  }
+  free(all);
+  free(threads);
+  free(latency);
+  return failures > 0;
+}
+
+static double now(void)
+{ struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec*1e-9;
+}
+
+//Returns a socket connected to the server, or -1
+static int connectServer(const char* socketPath)
+{ int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, socketPath, sizeof(address.sun_path)-1);
+  if(fd >= 0 && connect(fd, (struct sockaddr*)&address, sizeof(address)) != 0)
+  { close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+/********************************************************************
+* ask sends one request and reads the reply. On OK the payload is
+* returned in a new buffer in data. Returns TRUE on any error.
+********************************************************************/
+static int ask(int fd, const char* request, unsigned char** data,
+               size_t* size)
+{ size_t length = strlen(request);
+  if(write(fd, request, length) != (ssize_t)length)
+  { return TRUE;
+  }
+  //The reply line is short, read it a byte at a time
+  char line[128];
+  size_t used = 0;
+  while(used < sizeof(line)-1)
+  { if(readAll(fd, (unsigned char*)&line[used], 1)) return TRUE;
+    if(line[used] == '\n') break;
+    ++used;
+  }
+  line[used] = '\0';
+  if(sscanf(line, "OK %zu", size) != 1)
+  { printf("ERROR: Server replied %s\n", line);
+    return TRUE;
+  }
+  *data = malloc(*size ? *size : 1);
+  if(readAll(fd, *data, *size))
+  { free(*data);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+//Reads exactly size bytes. Returns TRUE on error or end of file
+static int readAll(int fd, unsigned char* buffer, size_t size)
+{ while(size > 0)
+  { ssize_t got = read(fd, buffer, size);
+    if(got < 0 && errno == EINTR) continue;
+    if(got <= 0)
+    { return TRUE;
+    }
+    buffer += got;
+    size -= (size_t)got;
+  }
+  return FALSE;
+}
+
+static int compareDouble(const void* a, const void* b)
+{ double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+//One client: a connection and its requests in turn
+static void* runClient(void* arg)
+{ struct client* client = arg;
+  int fd = connectServer(client->socketPath);
+  if(fd < 0)
+  { client->failed = TRUE;
+    return NULL;
+  }
+  int r;
+  for(r=0; r<client->requests; ++r)
+  { unsigned char* data;
+    size_t size;
+    double start = now();
+    if(ask(fd, client->request, &data, &size))
+    { client->failed = TRUE;
+      break;
+    }
+    client->latency[r] = now() - start;
+    client->bytes += size;
+    free(data);
+  }
+  close(fd);
+  return NULL;
+}
@@ -0,0 +1,440 @@
+/********************************************************************
+* Parallel Maze Carving
+*
+* mazeGenerateParallel carves the same kind of randomized depth first
+* maze as mazeGenerate, using many threads on one shared grid:
+*
+*   - Every thread starts its own depth first carve from its own seed
+*     cell. A cell is claimed by an atomic compare-and-swap of its
+*     value from NO_DIRECTIONS to VISITED plus the passage back to the
+*     cell it was reached from, so no two carves ever take one cell
+*     and no locks are needed on the grid.
+*   - A thread whose stack runs dry steals the oldest half of another
+*     thread's stack, which is the frontier that thread will not get
+*     back to for the longest time.
+*   - When every stack is empty each seed has grown a tree, and a
+*     union-find pass over the seeds' tree ids joins neighboring trees
+*     with one passage each, making a single spanning tree.
+*
+* The waypoint is handled as in mazeGenerate: the grid is carved as
+* two regions split at the waypoint's row (kept apart with makeWall)
+* that are joined only through the waypoint.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define STEAL_MINIMUM 2  //leave a stack alone if it holds fewer cells
+
+struct carveStack {
+  size_t* cells;
+  size_t bottom, top;   //live entries are [bottom, top)
+  size_t capacity;
+  pthread_mutex_t lock; //for steals only ever contended by thieves
+};
+
+struct carveState {
+  unsigned char* cells; //the grid, row-major
+  int* tree;            //seed number that claimed each cell
+  int threads;
+  struct carveStack* stacks;
+  int busy;             //threads not yet out of work, changed atomically
+  int failed;           //set when a stack cannot grow, stops every thread
+};
+
+struct carveWorker {
+  struct carveState* state;
+  int id;
+  unsigned int random;
+};
+
+static void* carveWorker(void* arg);
+static int takeWork(struct carveState* state, int id);
+static int pushCell(struct carveStack* stack, size_t cell);
+static int carveRegion(int firstRow, int lastRow, int threads,
+                       int* tree, int firstTree);
+static int joinTrees(int firstRow, int lastRow, int* tree,
+                     int firstTree, int trees);
+static unsigned int nextRandom(unsigned int* state);
+
+/********************************************************************
+* mazeGenerateParallel makes a maze like mazeGenerate does, carved by
+* threads threads. It is a perfect maze whose solution passes through
+* the waypoint, and the global model holds it afterwards as usual.
+*
+* Params:
+*   width, height, wayPointX, wayPointY: as for mazeGenerate
+*   threads: number of carving threads, at least 1
+*
+* Returns TRUE if an argument is out of range or there is not enough
+* memory, in which case there is no maze. Otherwise FALSE.
+********************************************************************/
+int mazeGenerateParallel(int width, int height,
+                         int wayPointX, int wayPointY, int threads)
+{ if(threads < 1)
+  { printf("ERROR: Invalid thread count\n");
+    return TRUE;
+  }
+  if(setupMaze(width, height, wayPointX, wayPointY))
+  { return TRUE;
+  }
+  int* tree = malloc((size_t)rows*columns*sizeof(int));
+  if(tree == NULL)
+  { printf("ERROR: Not enough memory to carve the maze\n");
+    mazeFree();
+    return TRUE;
+  }
+
+  //Region away from the middle first, walled off at the waypoint row
+  int firstRow, lastRow, linkRow;
+  if( wayPointY <= (rows-2)/2 )
+  { firstRow = wayPointY+1;
+    lastRow = rows-2;
+    linkRow = wayPointY+1;
+  }
+  else
+  { firstRow = 1;
+    lastRow = wayPointY-1;
+    linkRow = wayPointY-1;
+  }
+  makeWall( wayPointY, TRUE );
+  int failed = carveRegion(firstRow, lastRow, threads, tree, 0);
+  makeWall( wayPointY, FALSE );
+
+  //The rest, including the waypoint row
+  if(!failed && firstRow == 1)
+  { failed = carveRegion(wayPointY, rows-2, threads, tree, threads);
+  }
+  else if(!failed)
+  { failed = carveRegion(1, wayPointY, threads, tree, threads);
+  }
+  if(failed)
+  { printf("ERROR: Not enough memory to carve the maze\n");
+    free(tree);
+    mazeFree();
+    return TRUE;
+  }
+
+  //Join the two regions at the waypoint
+  if(linkRow > wayPointY)
+  { maze[linkRow][wayPointX] |= NORTH;
+    maze[wayPointY][wayPointX] |= SOUTH;
+  }
+  else
+  { maze[linkRow][wayPointX] |= SOUTH;
+    maze[wayPointY][wayPointX] |= NORTH;
+  }
+
+  free(tree);
+  finishMaze(wayPointX, wayPointY);
+  return FALSE;
+}
+
+/********************************************************************
+* carveRegion carves rows firstRow to lastRow with threads threads and
+* joins the resulting trees into one. The rows around the region must
+* already be nonzero (carved, border or wall) so no carve leaves it.
+*
+* Seeds are numbered from firstTree so the two regions of one maze
+* never share a tree id.
+*
+* Returns TRUE if there is not enough memory, leaving the region
+* partly carved. Otherwise FALSE.
+********************************************************************/
+static int carveRegion(int firstRow, int lastRow, int threads,
+                       int* tree, int firstTree)
+{ struct carveState state;
+  state.cells = *maze;
+  state.tree = tree;
+  state.threads = threads;
+  state.busy = threads;
+  state.failed = FALSE;
+  state.stacks = malloc(threads*sizeof(struct carveStack));
+  struct carveWorker* workers = malloc(threads*sizeof(struct carveWorker));
+  pthread_t* handles = malloc(threads*sizeof(pthread_t));
+  if(state.stacks == NULL || workers == NULL || handles == NULL)
+  { free(state.stacks);
+    free(workers);
+    free(handles);
+    return TRUE;
+  }
+
+  //More seeds than cells would never all find a free cell
+  int regionCells = (lastRow-firstRow+1)*(columns-2);
+  int seeds = threads < regionCells ? threads : regionCells;
+
+  int t;
+  for(t=0; t<threads; ++t)
+  { struct carveStack* stack = &state.stacks[t];
+    stack->capacity = 1024;
+    stack->cells = malloc(stack->capacity*sizeof(size_t));
+    stack->bottom = 0;
+    stack->top = 0;
+    pthread_mutex_init(&stack->lock, NULL);
+    workers[t].state = &state;
+    workers[t].id = t;
+    workers[t].random = (unsigned int)rand() | 1;
+
+    //Seed: any cell of the region no other seed has taken
+    if(stack->cells == NULL)
+    { state.failed = TRUE;
+    }
+    else if(t < seeds)
+    { size_t cell;
+      do
+      { int row = firstRow + rand()%(lastRow-firstRow+1);
+        int col = 1 + rand()%(columns-2);
+        cell = (size_t)row*columns + col;
+      } while(state.cells[cell] != NO_DIRECTIONS);
+      state.cells[cell] = VISITED;
+      tree[cell] = firstTree + t;
+      pushCell(stack, cell);
+    }
+  }
+
+  int started = 1;
+  if(!state.failed)
+  { for(started=1; started<threads; ++started)
+    { if(pthread_create(&handles[started], NULL, carveWorker,
+                        &workers[started]) != 0)
+      { break;
+      }
+    }
+    //Seeds of workers that could not start go to the calling thread
+    for(t=started; t<threads; ++t)
+    { pthread_mutex_lock(&state.stacks[0].lock);
+      while(state.stacks[t].top > state.stacks[t].bottom)
+      { if(pushCell(&state.stacks[0],
+                    state.stacks[t].cells[--state.stacks[t].top]))
+        { __atomic_store_n(&state.failed, TRUE, __ATOMIC_RELAXED);
+          break;
+        }
+      }
+      pthread_mutex_unlock(&state.stacks[0].lock);
+      __atomic_fetch_sub(&state.busy, 1, __ATOMIC_SEQ_CST);
+    }
+    //The calling thread is worker 0
+    carveWorker(&workers[0]);
+    for(t=1; t<started; ++t)
+    { pthread_join(handles[t], NULL);
+    }
+  }
+
+  for(t=0; t<threads; ++t)
+  { free(state.stacks[t].cells);
+    pthread_mutex_destroy(&state.stacks[t].lock);
+  }
+  free(state.stacks);
+  free(workers);
+  free(handles);
+  if(state.failed)
+  { return TRUE;
+  }
+  return joinTrees(firstRow, lastRow, tree, firstTree, seeds);
+}
+
+/********************************************************************
+* carveWorker runs one thread's depth first carve. Each step looks at
+* the cell on top of its stack and tries the neighbors in random
+* order, claiming the first free one; a cell with no free neighbor is
+* popped. Passage bits are set with atomic ors since other threads
+* read the same cells while trying to claim them. Every thread stops
+* once one of them has run out of memory.
+********************************************************************/
+static void* carveWorker(void* arg)
+{ struct carveWorker* worker = arg;
+  struct carveState* state = worker->state;
+  struct carveStack* stack = &state->stacks[worker->id];
+  unsigned char* cells = state->cells;
+  long offset[TOTAL_DIRECTIONS];
+  int d;
+  for(d=0; d<TOTAL_DIRECTIONS; ++d)
+  { offset[d] = (long)DIRECTION_DY[d]*columns + DIRECTION_DX[d];
+  }
+
+  while( !__atomic_load_n(&state->failed, __ATOMIC_RELAXED) )
+  { pthread_mutex_lock(&stack->lock);
+    if(stack->top == stack->bottom)
+    { pthread_mutex_unlock(&stack->lock);
+      if( !takeWork(state, worker->id) )
+      { break;
+      }
+      continue;
+    }
+    size_t cell = stack->cells[stack->top-1];
+    pthread_mutex_unlock(&stack->lock);
+
+    //Try the four directions starting from a random one
+    int first = (int)(nextRandom(&worker->random) >> 8) % TOTAL_DIRECTIONS;
+    int step = (nextRandom(&worker->random) & 256) ? 1 : 3;
+    int claimed = FALSE;
+    int k;
+    for(k=0; k<TOTAL_DIRECTIONS && !claimed; ++k)
+    { d = (first + k*step) % TOTAL_DIRECTIONS;
+      size_t next = cell + offset[d];
+      unsigned char expected = NO_DIRECTIONS;
+      if(__atomic_load_n(&cells[next], __ATOMIC_RELAXED) != NO_DIRECTIONS)
+      { continue;
+      }
+      int back = DIRECTION_LIST[(d + 2) % TOTAL_DIRECTIONS];
+      if(__atomic_compare_exchange_n(&cells[next], &expected,
+                                     (unsigned char)(VISITED | back), FALSE,
+                                     __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      { __atomic_fetch_or(&cells[cell], (unsigned char)DIRECTION_LIST[d],
+                          __ATOMIC_RELAXED);
+        state->tree[next] = state->tree[cell];
+        pthread_mutex_lock(&stack->lock);
+        if(pushCell(stack, next))
+        { __atomic_store_n(&state->failed, TRUE, __ATOMIC_RELAXED);
+        }
+        pthread_mutex_unlock(&stack->lock);
+        claimed = TRUE;
+      }
+    }
+    if(!claimed)
+    { pthread_mutex_lock(&stack->lock);
+      //A thief may have taken it meanwhile, then it is theirs to pop
+      if(stack->top > stack->bottom && stack->cells[stack->top-1] == cell)
+      { --stack->top;
+      }
+      pthread_mutex_unlock(&stack->lock);
+    }
+  }
+  return NULL;
+}
+
+/********************************************************************
+* takeWork is called when a thread's stack is empty. It steals the
+* oldest half of the first stack it finds with enough cells on it,
+* and keeps looking while any thread still holds cells.
+*
+* Returns TRUE if work was stolen, FALSE when the region is done or
+* a thread has run out of memory.
+********************************************************************/
+static int takeWork(struct carveState* state, int id)
+{ struct carveStack* mine = &state->stacks[id];
+  __atomic_fetch_sub(&state->busy, 1, __ATOMIC_SEQ_CST);
+  while(__atomic_load_n(&state->busy, __ATOMIC_SEQ_CST) > 0 &&
+        !__atomic_load_n(&state->failed, __ATOMIC_RELAXED))
+  { int k;
+    for(k=1; k<state->threads; ++k)
+    { struct carveStack* victim = &state->stacks[(id + k) % state->threads];
+      pthread_mutex_lock(&victim->lock);
+      size_t held = victim->top - victim->bottom;
+      if(held < STEAL_MINIMUM)
+      { pthread_mutex_unlock(&victim->lock);
+        continue;
+      }
+      //Copy out first so no thread ever holds two stack locks
+      size_t count = held/2;
+      size_t* stolen = malloc(count*sizeof(size_t));
+      if(stolen == NULL)
+      { pthread_mutex_unlock(&victim->lock);
+        __atomic_store_n(&state->failed, TRUE, __ATOMIC_RELAXED);
+        return FALSE;
+      }
+      memcpy(stolen, victim->cells + victim->bottom, count*sizeof(size_t));
+      victim->bottom += count;
+      __atomic_fetch_add(&state->busy, 1, __ATOMIC_SEQ_CST);
+      pthread_mutex_unlock(&victim->lock);
+
+      pthread_mutex_lock(&mine->lock);
+      size_t i;
+      for(i=0; i<count; ++i)
+      { if(pushCell(mine, stolen[i]))
+        { __atomic_store_n(&state->failed, TRUE, __ATOMIC_RELAXED);
+          break;
+        }
+      }
+      pthread_mutex_unlock(&mine->lock);
+      free(stolen);
+      return TRUE;
+    }
+    sched_yield();
+  }
+  return FALSE;
+}
+
+//Pushes cell onto stack. Caller holds the stack's lock. Returns TRUE,
+//  leaving the stack as it was, if it cannot grow
+static int pushCell(struct carveStack* stack, size_t cell)
+{ if(stack->top == stack->capacity)
+  { //Slide the live entries down before growing
+    size_t held = stack->top - stack->bottom;
+    memmove(stack->cells, stack->cells + stack->bottom, held*sizeof(size_t));
+    stack->bottom = 0;
+    stack->top = held;
+    if(held*2 > stack->capacity)
+    { size_t* more = realloc(stack->cells, 2*stack->capacity*sizeof(size_t));
+      if(more == NULL)
+      { return TRUE;
+      }
+      stack->cells = more;
+      stack->capacity *= 2;
+    }
+  }
+  stack->cells[stack->top++] = cell;
+  return FALSE;
+}
+
+/********************************************************************
+* joinTrees walks the passages that could exist between neighboring
+* cells of the region and opens one wherever the two sides belong to
+* trees that are not yet joined. The union-find is over seed numbers,
+* so it is tiny; the walk is one pass over the region's rows.
+*
+* Returns TRUE if there is not enough memory. Otherwise FALSE.
+********************************************************************/
+static int joinTrees(int firstRow, int lastRow, int* tree,
+                     int firstTree, int trees)
+{ int* parent = malloc(trees*sizeof(int));
+  if(parent == NULL)
+  { return TRUE;
+  }
+  int t, joined = 0;
+  for(t=0; t<trees; ++t)
+  { parent[t] = t;
+  }
+  int i,j;
+  for(i=firstRow; i<=lastRow && joined < trees-1; ++i)
+  { for(j=1; j<columns-1 && joined < trees-1; ++j)
+    { int here = tree[(size_t)i*columns + j] - firstTree;
+      int d;
+      //East and south neighbors inside the region
+      for(d=1; d<=2; ++d)
+      { int nextRow = i + DIRECTION_DY[d], nextCol = j + DIRECTION_DX[d];
+        if(nextRow > lastRow || nextCol > columns-2)
+        { continue;
+        }
+        int there = tree[(size_t)nextRow*columns + nextCol] - firstTree;
+        int a = here, b = there;
+        while(parent[a] != a) a = parent[a] = parent[parent[a]];
+        while(parent[b] != b) b = parent[b] = parent[parent[b]];
+        if(a == b)
+        { continue;
+        }
+        parent[b] = a;
+        ++joined;
+        maze[i][j] |= DIRECTION_LIST[d];
+        maze[nextRow][nextCol] |= DIRECTION_LIST[(d + 2) % TOTAL_DIRECTIONS];
+      }
+    }
+  }
+  free(parent);
+  return FALSE;
+}
+
+//xorshift, one per thread so carving never shares rand()'s state
+static unsigned int nextRandom(unsigned int* state)
+{ unsigned int x = *state;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  *state = x;
+  return x;
+}
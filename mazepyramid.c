@@ -0,0 +1,405 @@
+/********************************************************************
+* Tiled Image Pyramid
+*
+* mazePyramid writes the current maze as a set of square bmp tiles at
+* several zoom levels, so a viewer only has to load the tiles it is
+* showing instead of one enormous image.
+*
+*   Level 0 is full resolution, 8 pixels per cell, drawn from the
+*   maze blocks exactly as mazePrint draws them.
+*   Level L is half the size of level L-1 on each side. Levels 1 and 2
+*   (4 and 2 pixels per cell) shade each pixel by the share of wall in
+*   the part of the cell's block it covers. From level 3 (1 pixel per
+*   cell) on, each pixel is the wall density of a block of cells.
+*
+* None of the overview levels are scaled down from a full resolution
+* image. Level 3 is computed once from the direction bits of each cell
+* and every coarser level averages 2x2 entries of the level below, so
+* all the overview levels together cost about one pass over the grid.
+*
+* Tiles are written as <directory>/<level>/<x>/<y>.bmp with x and y
+* counted in tiles from the top left. Levels stop at the first one
+* that fits in a single tile.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define MAX_DENSITY 255
+#define CELL_LEVEL 3    //first level with 1 pixel per cell
+
+struct densityLevel {
+  int width, height;     //in pixels, one pixel per entry
+  unsigned char* wall;   //wall density, 0 to MAX_DENSITY
+};
+
+struct pyramidState {
+  const char* directory;
+  int tilePixels;
+  int levels;
+  int* tilesAcross;     //per level
+  int* tilesDown;       //per level
+  int* levelWidth;      //per level, in pixels
+  int* levelHeight;
+  struct densityLevel* density; //indexed by level, from CELL_LEVEL
+  int nextTile;         //next tile number to hand out, over all levels
+  int totalTiles;
+  int writeErrors;
+  pthread_mutex_t lock;
+};
+
+//Wall density of each sub-square of each block at levels 0 to 2
+static unsigned char subBlockDensity[CELL_LEVEL][ALL_DIRECTIONS+1]
+                                    [PIXELS_IN_BLOCK];
+
+static void buildSubBlockDensity(void);
+static int buildDensityLevels(struct pyramidState* state);
+static void* tileWorker(void* arg);
+static int renderTile(struct pyramidState* state, int level,
+                      int tileX, int tileY, unsigned char* image);
+static int makeDirectory(const char* path);
+
+/********************************************************************
+* mazePyramid writes the tile pyramid of the current maze.
+*
+* Params:
+*   directory: existing or new directory to write the levels into
+*   tilePixels: side of a tile in pixels, a multiple of 8
+*   threads: number of threads rendering and writing tiles
+*
+* Returns TRUE if there is no maze, an argument is invalid, there is
+*   not enough memory or a tile could not be written. Otherwise FALSE.
+********************************************************************/
+int mazePyramid(const char* directory, int tilePixels, int threads)
+{ if(maze == NULL || rows < 3)
+  { printf("ERROR: No maze to write\n");
+    return TRUE;
+  }
+  if(directory == NULL || tilePixels < PIXELS_ON_PIECE_SIDE ||
+     tilePixels % PIXELS_ON_PIECE_SIDE != 0 || threads < 1)
+  { printf("ERROR: Invalid pyramid argument\n");
+    return TRUE;
+  }
+  loadMazeBlocks();
+  buildSubBlockDensity();
+
+  struct pyramidState state;
+  state.directory = directory;
+  state.tilePixels = tilePixels;
+  state.writeErrors = 0;
+  state.nextTile = 0;
+  state.totalTiles = 0;
+  pthread_mutex_init(&state.lock, NULL);
+
+  //Count levels: halve until everything fits in one tile
+  int width = (columns-2)*PIXELS_ON_PIECE_SIDE;
+  int height = (rows-2)*PIXELS_ON_PIECE_SIDE;
+  int levels = 1;
+  while(width > tilePixels || height > tilePixels)
+  { width = (width+1)/2;
+    height = (height+1)/2;
+    ++levels;
+  }
+  state.levels = levels;
+  state.tilesAcross = malloc(levels*sizeof(int));
+  state.tilesDown = malloc(levels*sizeof(int));
+  state.levelWidth = malloc(levels*sizeof(int));
+  state.levelHeight = malloc(levels*sizeof(int));
+  state.density = calloc(levels > CELL_LEVEL ? levels : CELL_LEVEL+1,
+                         sizeof(struct densityLevel));
+  if(state.tilesAcross == NULL || state.tilesDown == NULL ||
+     state.levelWidth == NULL || state.levelHeight == NULL ||
+     state.density == NULL)
+  { printf("ERROR: Not enough memory for the pyramid\n");
+    free(state.density);
+    free(state.tilesAcross);
+    free(state.tilesDown);
+    free(state.levelWidth);
+    free(state.levelHeight);
+    pthread_mutex_destroy(&state.lock);
+    return TRUE;
+  }
+
+  char path[512];
+  int failed = makeDirectory(directory);
+  int level, x;
+  width = (columns-2)*PIXELS_ON_PIECE_SIDE;
+  height = (rows-2)*PIXELS_ON_PIECE_SIDE;
+  for(level=0; level<levels; ++level)
+  { state.levelWidth[level] = width;
+    state.levelHeight[level] = height;
+    state.tilesAcross[level] = (width + tilePixels - 1)/tilePixels;
+    state.tilesDown[level] = (height + tilePixels - 1)/tilePixels;
+    state.totalTiles += state.tilesAcross[level]*state.tilesDown[level];
+    snprintf(path, sizeof(path), "%s/%d", directory, level);
+    failed |= makeDirectory(path);
+    for(x=0; x<state.tilesAcross[level]; ++x)
+    { snprintf(path, sizeof(path), "%s/%d/%d", directory, level, x);
+      failed |= makeDirectory(path);
+    }
+    width = (width+1)/2;
+    height = (height+1)/2;
+  }
+  if(failed)
+  { printf("ERROR: Could not create pyramid directories in %s\n", directory);
+  }
+  else if(buildDensityLevels(&state))
+  { printf("ERROR: Not enough memory for the pyramid overview levels\n");
+    failed = TRUE;
+  }
+  else
+  { //Without room for the handles the calling thread does every tile
+    pthread_t* workers = malloc(threads*sizeof(pthread_t));
+    int started = 0;
+    if(workers != NULL)
+    { for(started=0; started<threads; ++started)
+      { if(pthread_create(&workers[started], NULL, tileWorker, &state) != 0)
+        { break;
+        }
+      }
+    }
+    if(started == 0)
+    { tileWorker(&state);
+    }
+    int t;
+    for(t=0; t<started; ++t)
+    { pthread_join(workers[t], NULL);
+    }
+    free(workers);
+    //Tiles are left only if no worker could get an image buffer
+    if(state.nextTile < state.totalTiles)
+    { printf("ERROR: Not enough memory to render the pyramid tiles\n");
+    }
+    failed = state.writeErrors > 0 || state.nextTile < state.totalTiles;
+  }
+
+  for(level=CELL_LEVEL; level<levels; ++level)
+  { free(state.density[level].wall);
+  }
+  free(state.density);
+  free(state.tilesAcross);
+  free(state.tilesDown);
+  free(state.levelWidth);
+  free(state.levelHeight);
+  pthread_mutex_destroy(&state.lock);
+  return failed;
+}
+
+/********************************************************************
+* buildSubBlockDensity fills subBlockDensity for the levels that have
+* more than one pixel per cell. At level L a pixel covers a square of
+* 2^L by 2^L block pixels, and its entry is the share of those that
+* are wall.
+********************************************************************/
+static void buildSubBlockDensity(void)
+{ int level, n, k, m;
+  for(level=0; level<CELL_LEVEL; ++level)
+  { int span = 1 << level;
+    int side = PIXELS_ON_PIECE_SIDE / span;
+    for(n=0; n<=ALL_DIRECTIONS; ++n)
+    { for(k=0; k<side; ++k)
+      { for(m=0; m<side; ++m)
+        { int walls = 0, a, b;
+          for(a=0; a<span; ++a)
+          { for(b=0; b<span; ++b)
+            { walls += blockIsWall(n, k*span + a, m*span + b);
+            }
+          }
+          subBlockDensity[level][n][k*side + m] =
+            (unsigned char)(walls*MAX_DENSITY/(span*span));
+        }
+      }
+    }
+  }
+}
+
+/********************************************************************
+* buildDensityLevels computes the wall density grids for levels
+* CELL_LEVEL and up. Level CELL_LEVEL has one entry per cell, and each
+* coarser level averages the (up to) 2x2 entries below it.
+*
+* Returns TRUE if a grid could not be allocated. The grids that were
+* are left for mazePyramid to free.
+********************************************************************/
+static int buildDensityLevels(struct pyramidState* state)
+{ if(state->levels <= CELL_LEVEL)
+  { return FALSE;
+  }
+  //Share of each block that is wall
+  unsigned char cellDensity[ALL_DIRECTIONS+1];
+  int n, k, m;
+  for(n=0; n<=ALL_DIRECTIONS; ++n)
+  { int walls = 0;
+    for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+    { for(m=0; m<PIXELS_ON_PIECE_SIDE; ++m)
+      { walls += blockIsWall(n, k, m);
+      }
+    }
+    cellDensity[n] = (unsigned char)(walls*MAX_DENSITY/PIXELS_IN_BLOCK);
+  }
+
+  struct densityLevel* base = &state->density[CELL_LEVEL];
+  base->width = columns-2;
+  base->height = rows-2;
+  base->wall = malloc((size_t)base->width*base->height);
+  if(base->wall == NULL)
+  { return TRUE;
+  }
+  int i, j;
+  for(i=0; i<base->height; ++i)
+  { const unsigned char* row = maze[i+1] + 1;
+    unsigned char* dest = base->wall + (size_t)i*base->width;
+    for(j=0; j<base->width; ++j)
+    { dest[j] = cellDensity[row[j] & ALL_DIRECTIONS];
+    }
+  }
+
+  int level;
+  for(level=CELL_LEVEL+1; level<state->levels; ++level)
+  { struct densityLevel* below = &state->density[level-1];
+    struct densityLevel* here = &state->density[level];
+    here->width = (below->width+1)/2;
+    here->height = (below->height+1)/2;
+    here->wall = malloc((size_t)here->width*here->height);
+    if(here->wall == NULL)
+    { return TRUE;
+    }
+    for(i=0; i<here->height; ++i)
+    { for(j=0; j<here->width; ++j)
+      { int sum = 0, count = 0, a, b;
+        for(a=2*i; a<2*i+2 && a<below->height; ++a)
+        { for(b=2*j; b<2*j+2 && b<below->width; ++b)
+          { sum += below->wall[(size_t)a*below->width + b];
+            ++count;
+          }
+        }
+        here->wall[(size_t)i*here->width + j] = (unsigned char)(sum/count);
+      }
+    }
+  }
+  return FALSE;
+}
+
+/********************************************************************
+* tileWorker takes tile numbers from the shared counter until every
+* tile at every level has been written. Each worker keeps one tile
+* sized image buffer for its whole run; a worker that cannot get one
+* takes no tiles and leaves them to the others.
+********************************************************************/
+static void* tileWorker(void* arg)
+{ struct pyramidState* state = arg;
+  unsigned char* image = malloc(imageFileSize(state->tilePixels,
+                                              state->tilePixels));
+  if(image == NULL)
+  { return NULL;
+  }
+  while(TRUE)
+  { pthread_mutex_lock(&state->lock);
+    int tile = state->nextTile++;
+    pthread_mutex_unlock(&state->lock);
+    if(tile >= state->totalTiles)
+    { break;
+    }
+    int level = 0;
+    while(tile >= state->tilesAcross[level]*state->tilesDown[level])
+    { tile -= state->tilesAcross[level]*state->tilesDown[level];
+      ++level;
+    }
+    int tileX = tile % state->tilesAcross[level];
+    int tileY = tile / state->tilesAcross[level];
+    if(renderTile(state, level, tileX, tileY, image))
+    { pthread_mutex_lock(&state->lock);
+      ++state->writeErrors;
+      pthread_mutex_unlock(&state->lock);
+    }
+  }
+  free(image);
+  return NULL;
+}
+
+//Blends floor and wall colors by density, 0 is floor
+static unsigned int shade(int density)
+{ unsigned int color = 0;
+  int p;
+  for(p=0; p<COLOR_DEPTH_IN_BYTES; ++p)
+  { int floor = (FLOOR_COLOR >> (8*p)) & 0xFF;
+    int wall = (WALL_COLOR >> (8*p)) & 0xFF;
+    color |= (unsigned int)(floor + (wall-floor)*density/MAX_DENSITY) << (8*p);
+  }
+  return color;
+}
+
+/********************************************************************
+* renderTile draws one tile into image and writes it to disk. Tiles on
+* the right and bottom edges of a level are cropped to the level.
+*
+* Returns TRUE if the file could not be written.
+********************************************************************/
+static int renderTile(struct pyramidState* state, int level,
+                      int tileX, int tileY, unsigned char* image)
+{ int x0 = tileX*state->tilePixels;
+  int y0 = tileY*state->tilePixels;
+  int width = state->levelWidth[level] - x0;
+  int height = state->levelHeight[level] - y0;
+  if(width > state->tilePixels) width = state->tilePixels;
+  if(height > state->tilePixels) height = state->tilePixels;
+  imageHeader(image, width, height);
+
+  int x, y;
+  for(y=0; y<height; ++y)
+  { unsigned char* dest = imagePixel(image, width, height, 0, y);
+    for(x=0; x<width; ++x)
+    { unsigned int color;
+      if(level == 0)
+      { int px = x0 + x, py = y0 + y;
+        unsigned char cell = maze[py/PIXELS_ON_PIECE_SIDE + 1]
+                                 [px/PIXELS_ON_PIECE_SIDE + 1];
+        int isWayPoint = py/PIXELS_ON_PIECE_SIDE + 1 == wayY &&
+                         px/PIXELS_ON_PIECE_SIDE + 1 == wayX;
+        color = cellPixel(cell, isWayPoint, py%PIXELS_ON_PIECE_SIDE,
+                          px%PIXELS_ON_PIECE_SIDE);
+      }
+      else if(level < CELL_LEVEL)
+      { int side = PIXELS_ON_PIECE_SIDE >> level;
+        int px = x0 + x, py = y0 + y;
+        unsigned char cell = maze[py/side + 1][px/side + 1];
+        color = shade(subBlockDensity[level][cell & ALL_DIRECTIONS]
+                                     [(py%side)*side + px%side]);
+      }
+      else
+      { struct densityLevel* grid = &state->density[level];
+        color = shade(grid->wall[(size_t)(y0+y)*grid->width + x0 + x]);
+      }
+      dest[0] = (unsigned char)(color);
+      dest[1] = (unsigned char)(color >> 8);
+      dest[2] = (unsigned char)(color >> 16);
+      dest += COLOR_DEPTH_IN_BYTES;
+    }
+  }
+
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%d/%d/%d.bmp",
+           state->directory, level, tileX, tileY);
+  FILE* tileFile = fopen(path, "wb");
+  if(tileFile == NULL)
+  { return TRUE;
+  }
+  size_t size = imageFileSize(width, height);
+  int failed = fwrite(image, sizeof(unsigned char), size, tileFile) != size;
+  failed |= fclose(tileFile) != 0;
+  return failed;
+}
+
+//Returns TRUE if path is not a directory and could not be made one
+static int makeDirectory(const char* path)
+{ if(mkdir(path, 0755) == 0 || errno == EEXIST)
+  { return FALSE;
+  }
+  return TRUE;
+}
@@ -0,0 +1,375 @@
+/********************************************************************
+* Region Re-carving
+*
+* Re-randomizes a rectangle of cells and leaves the rest of the maze
+* alone, at a cost proportional to the rectangle's area.
+*
+* Cutting a perfect maze along the rectangle splits its tree into
+* pieces inside and components outside, joined by the passages that
+* cross the edge of the rectangle (the openings). The pieces and
+* components themselves form a tree through the openings. Which
+* openings lead into the same outside component is a property of the
+* whole maze, so the openings are kept as they are, and each piece is
+* rebuilt around them:
+*
+*   1. Cells that are not needed to join a piece's openings are pruned
+*      away leaf by leaf. The waypoint and the entrance and exit count
+*      as openings. What is left, the skeleton, is one small tree per
+*      piece.
+*   2. The rectangle is cleared and the skeletons grow back over it in
+*      a random depth first order, each cell going to whichever
+*      skeleton reaches it first.
+*   3. Each skeleton's share of the rectangle is carved again from
+*      scratch with the randomized depth first search, the skeleton's
+*      old passages included.
+*
+* Every piece still joins the same openings, so the maze stays
+* perfect. The waypoint gets a share of its own, joined to the
+* skeleton around it by the old passages only, so any path that used
+* to go through it still does, the solution included.
+*
+* As in makeWall, the carve is kept inside the rectangle by a ring of
+* SPECIAL cells around it, put up first and taken down at the end.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define PRUNED   -1   //not part of any skeleton
+#define SKELETON -2   //part of a skeleton, share not numbered yet
+#define OPENING  (2*TOTAL_DIRECTIONS)  //never pruned, see pruneCells
+
+//The rectangle being re-carved, in grid rows and columns
+static int top, left, height, width;
+
+static int regionCell(int row, int col);
+static int inRegion(int row, int col);
+static void makeRing(int mode);
+static void pruneCells(int* share, int* stack);
+static void numberShares(int* share, int* stack);
+static void growShares(int* share, int* stack);
+static void carveShare(int row, int col, int* share, int* stack);
+static void clearSolution(void);
+
+/********************************************************************
+* mazeRecarve clears and re-carves the w by h cells of the current
+* maze whose top left cell is (x0, y0), counted from 1 like the
+* waypoint. The maze outside the rectangle and every passage across
+* its edge are unchanged, and the maze stays perfect with its solution
+* through the waypoint. The changed cells are marked for
+* mazeRenderChanges. A solution found by mazeSolve is wiped, which
+* takes one pass over the maze, and the path index is dropped.
+*
+* Params:
+*   x0, y0, w, h: the rectangle, which must lie inside the maze
+*
+* Returns TRUE if there is no maze or the rectangle is out of range.
+*   Otherwise FALSE.
+********************************************************************/
+int mazeRecarve(int x0, int y0, int w, int h)
+{ if(maze == NULL || x0 < 1 || y0 < 1 || w < 1 || h < 1 ||
+     x0+w-1 > columns-2 || y0+h-1 > rows-2)
+  { printf("ERROR: Region out of range\n");
+    return TRUE;
+  }
+  top = y0;
+  left = x0;
+  height = h;
+  width = w;
+  size_t cells = (size_t)w*h;
+  int* share = malloc(cells*sizeof(int));
+  int* stack = malloc(cells*sizeof(int));
+  unsigned char* openings = malloc(cells);
+  if(share == NULL || stack == NULL || openings == NULL)
+  { printf("ERROR: Region too large\n");
+    free(share);
+    free(stack);
+    free(openings);
+    return TRUE;
+  }
+  clearSolution();
+  releaseIndex();
+
+  pruneCells(share, stack);
+  numberShares(share, stack);
+
+  //Keep the passages across the edge, and the waypoint's to the skeleton
+  int wayLinks = 0, row, col, d;
+  for(row=top; row<top+height; ++row)
+  { for(col=left; col<left+width; ++col)
+    { int sides = maze[row][col] & ALL_DIRECTIONS;
+      for(d=0; d<TOTAL_DIRECTIONS; ++d)
+      { int nextRow = row + DIRECTION_DY[d], nextCol = col + DIRECTION_DX[d];
+        if(inRegion(nextRow, nextCol))
+        { if(row == wayY && col == wayX && (sides & DIRECTION_LIST[d]) &&
+             share[regionCell(nextRow, nextCol)] != PRUNED)
+          { wayLinks |= DIRECTION_LIST[d];
+          }
+          sides &= ~DIRECTION_LIST[d];
+        }
+      }
+      openings[regionCell(row, col)] = (unsigned char)sides;
+      markDirty(row, col);
+    }
+  }
+
+  makeRing(TRUE);
+  growShares(share, stack);
+  //Carve each share from its first cell, marks cleared as carving goes
+  for(row=top; row<top+height; ++row)
+  { for(col=left; col<left+width; ++col)
+    { maze[row][col] = NO_DIRECTIONS;
+    }
+  }
+  for(row=top; row<top+height; ++row)
+  { for(col=left; col<left+width; ++col)
+    { if(maze[row][col] == NO_DIRECTIONS)
+      { carveShare(row, col, share, stack);
+      }
+    }
+  }
+  makeRing(FALSE);
+
+  for(row=top; row<top+height; ++row)
+  { for(col=left; col<left+width; ++col)
+    { maze[row][col] = (maze[row][col] & ~VISITED) |
+                       openings[regionCell(row, col)];
+      if(row == rows-2 && (maze[row][col] & SOUTH))
+      { maze[row][col] |= GOAL;
+      }
+    }
+  }
+  for(d=0; d<TOTAL_DIRECTIONS; ++d)
+  { if(wayLinks & DIRECTION_LIST[d])
+    { maze[wayY][wayX] |= DIRECTION_LIST[d];
+      maze[wayY + DIRECTION_DY[d]][wayX + DIRECTION_DX[d]] |=
+        DIRECTION_LIST[(d+2)%TOTAL_DIRECTIONS];
+    }
+  }
+  free(share);
+  free(stack);
+  free(openings);
+  return FALSE;
+}
+
+//Index of the cell at row, col in the rectangle's arrays
+static int regionCell(int row, int col)
+{ return (row-top)*width + (col-left);
+}
+
+static int inRegion(int row, int col)
+{ return row >= top && row < top+height && col >= left && col < left+width;
+}
+
+/********************************************************************
+* makeRing puts SPECIAL cells all around the rectangle, like makeWall
+* does across a row, so that carving cannot leave it. With FALSE it
+* takes them down again. The maze's own border is SPECIAL already and
+* stays that way.
+********************************************************************/
+static void makeRing(int mode)
+{ int i;
+  for(i=left-1; i<=left+width; ++i)
+  { if(mode == FALSE)
+    { if(top-1 > 0 && i > 0 && i < columns-1)
+        maze[top-1][i] &= ~SPECIAL;
+      if(top+height < rows-1 && i > 0 && i < columns-1)
+        maze[top+height][i] &= ~SPECIAL;
+    }
+    else
+    { maze[top-1][i] |= SPECIAL;
+      maze[top+height][i] |= SPECIAL;
+    }
+  }
+  for(i=top; i<top+height; ++i)
+  { if(mode == FALSE)
+    { if(left-1 > 0) maze[i][left-1] &= ~SPECIAL;
+      if(left+width < columns-1) maze[i][left+width] &= ~SPECIAL;
+    }
+    else
+    { maze[i][left-1] |= SPECIAL;
+      maze[i][left+width] |= SPECIAL;
+    }
+  }
+}
+
+/********************************************************************
+* pruneCells finds the skeleton. Each cell starts with the number of
+* passages it has to other cells of the rectangle, or OPENING if it
+* has a passage across the edge or is the waypoint. Cells left with
+* one passage or none are pruned, which can leave a neighbor with
+* one, until only the paths between openings remain. The skeleton
+* cells end up SKELETON, the rest PRUNED.
+********************************************************************/
+static void pruneCells(int* share, int* stack)
+{ int depth = 0, row, col, d;
+  for(row=top; row<top+height; ++row)
+  { for(col=left; col<left+width; ++col)
+    { int i = regionCell(row, col), count = 0, opening = FALSE;
+      for(d=0; d<TOTAL_DIRECTIONS; ++d)
+      { if(maze[row][col] & DIRECTION_LIST[d])
+        { if(inRegion(row + DIRECTION_DY[d], col + DIRECTION_DX[d])) ++count;
+          else opening = TRUE;
+        }
+      }
+      share[i] = (opening || (row == wayY && col == wayX)) ? OPENING : count;
+      if(share[i] <= 1)
+      { stack[depth++] = i;
+      }
+    }
+  }
+  while(depth > 0)
+  { int i = stack[--depth];
+    share[i] = PRUNED;
+    row = i/width + top;
+    col = i%width + left;
+    for(d=0; d<TOTAL_DIRECTIONS; ++d)
+    { int nextRow = row + DIRECTION_DY[d], nextCol = col + DIRECTION_DX[d];
+      if((maze[row][col] & DIRECTION_LIST[d]) && inRegion(nextRow, nextCol))
+      { int next = regionCell(nextRow, nextCol);
+        //Already pruned or waiting on the stack at 0 or 1
+        if(share[next] >= 2 && --share[next] == 1)
+        { stack[depth++] = next;
+        }
+      }
+    }
+  }
+  for(row=0; row<height*width; ++row)
+  { if(share[row] != PRUNED) share[row] = SKELETON;
+  }
+}
+
+/********************************************************************
+* numberShares gives each skeleton its own number, following the old
+* passages between skeleton cells. The waypoint is numbered on its own
+* and cuts the skeleton it sits on into parts that are numbered apart.
+********************************************************************/
+static void numberShares(int* share, int* stack)
+{ int next = 0, i, d;
+  if(inRegion(wayY, wayX))
+  { share[regionCell(wayY, wayX)] = next++;
+  }
+  for(i=0; i<height*width; ++i)
+  { if(share[i] != SKELETON)
+    { continue;
+    }
+    int depth = 0;
+    share[i] = next;
+    stack[depth++] = i;
+    while(depth > 0)
+    { int cell = stack[--depth];
+      int row = cell/width + top, col = cell%width + left;
+      for(d=0; d<TOTAL_DIRECTIONS; ++d)
+      { int nextRow = row + DIRECTION_DY[d], nextCol = col + DIRECTION_DX[d];
+        if((maze[row][col] & DIRECTION_LIST[d]) && inRegion(nextRow, nextCol) &&
+           share[regionCell(nextRow, nextCol)] == SKELETON)
+        { share[regionCell(nextRow, nextCol)] = next;
+          stack[depth++] = regionCell(nextRow, nextCol);
+        }
+      }
+    }
+    ++next;
+  }
+}
+
+/********************************************************************
+* growShares hands every pruned cell to a skeleton. The rectangle is
+* cleared with the skeleton cells VISITED, then a depth first search
+* like carveInBand runs from all of them at once, off a stack that
+* starts with the skeleton cells in random order. A cell reached from
+* the top of the stack joins the same share.
+********************************************************************/
+static void growShares(int* share, int* stack)
+{ int depth = 0, row, col, i;
+  for(row=top; row<top+height; ++row)
+  { for(col=left; col<left+width; ++col)
+    { i = regionCell(row, col);
+      maze[row][col] = (share[i] == PRUNED) ? NO_DIRECTIONS : VISITED;
+      if(share[i] != PRUNED)
+      { stack[depth++] = i;
+      }
+    }
+  }
+  shuffle(stack, (size_t)depth);
+  while(depth > 0)
+  { int cell = stack[depth-1];
+    row = cell/width + top;
+    col = cell%width + left;
+    int open[TOTAL_DIRECTIONS];
+    int count = 0;
+    for(i=0; i<TOTAL_DIRECTIONS; ++i)
+    { if(maze[row + DIRECTION_DY[i]][col + DIRECTION_DX[i]] == NO_DIRECTIONS)
+      { open[count++] = i;
+      }
+    }
+    if(count == 0)
+    { --depth;
+      continue;
+    }
+    i = open[rand()%count];
+    int next = regionCell(row + DIRECTION_DY[i], col + DIRECTION_DX[i]);
+    maze[row + DIRECTION_DY[i]][col + DIRECTION_DX[i]] = VISITED;
+    share[next] = share[cell];
+    stack[depth++] = next;
+  }
+}
+
+/********************************************************************
+* carveShare is carveInBand kept to one share: a randomized depth
+* first search from row, col that only steps into uncarved cells of
+* the same share. The ring keeps it inside the rectangle, so the share
+* of a cell is only looked up once the cell is known to be in it.
+********************************************************************/
+static void carveShare(int row, int col, int* share, int* stack)
+{ int depth = 0, own = share[regionCell(row, col)];
+  maze[row][col] = VISITED;
+  stack[depth++] = regionCell(row, col);
+  while(depth > 0)
+  { int cell = stack[depth-1];
+    row = cell/width + top;
+    col = cell%width + left;
+    int open[TOTAL_DIRECTIONS];
+    int count = 0, i;
+    for(i=0; i<TOTAL_DIRECTIONS; ++i)
+    { int nextRow = row + DIRECTION_DY[i], nextCol = col + DIRECTION_DX[i];
+      if(maze[nextRow][nextCol] == NO_DIRECTIONS &&
+         share[regionCell(nextRow, nextCol)] == own)
+      { open[count++] = i;
+      }
+    }
+    if(count == 0)
+    { --depth;
+      continue;
+    }
+    i = open[rand()%count];
+    int nextRow = row + DIRECTION_DY[i], nextCol = col + DIRECTION_DX[i];
+    maze[row][col] |= DIRECTION_LIST[i];
+    maze[nextRow][nextCol] = VISITED | DIRECTION_LIST[(i+2)%TOTAL_DIRECTIONS];
+    stack[depth++] = regionCell(nextRow, nextCol);
+  }
+}
+
+//Wipes the marks mazeSolve left, if any, redrawing the old solution
+static void clearSolution(void)
+{ int i,j;
+  for(j=1; j<columns-1; ++j)
+  { if(maze[1][j] & NORTH) break;
+  }
+  if(j == columns-1 || !(maze[1][j] & VISITED))
+  { return;
+  }
+  for(i=1; i<rows-1; ++i)
+  { for(j=1; j<columns-1; ++j)
+    { if((maze[i][j] & (GOAL|VISITED)) == (GOAL|VISITED))
+      { markDirty(i, j);
+      }
+      maze[i][j] &= ~VISITED;
+      if(!(i == rows-2 && (maze[i][j] & SOUTH)))
+      { maze[i][j] &= ~GOAL;
+      }
+    }
+  }
+}
@@ -0,0 +1,482 @@
+/********************************************************************
+* Maze Rendering
+*
+* Turns a maze grid into an in-memory 24 bit bmp image. The grid is
+* passed in explicitly instead of being read from the global model so
+* that rendering can run on any thread against a snapshot of a maze
+* while the generator is already carving the next one.
+*
+* Each cell is drawn as the 8x8 block stored in mazeBitMapN.bmp, where
+* N is the cell's direction bits. The blocks are read from disk once
+* and kept in blockPixels for every render after that, together with
+* copies whose floor is recolored for solution cells and the waypoint.
+*
+* Cells whose picture changes after a full render (mazeSolve marking
+* the solution, or edits to the grid) are remembered as dirty, so that
+* mazePrintChanges and mazeRenderChanges can redraw just their blocks
+* in an image that already exists. Once more cells are remembered than
+* the maze has, or there is no memory for more, the list gives way to
+* redrawing everything.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+#include "bmpStruct.h"
+
+#define BMP_BLOCK_SIZE 246 //in bytes
+
+//Block styles, the first index of blockPixels
+#define STYLE_PLAIN    0
+#define STYLE_SOLUTION 1
+#define STYLE_WAYPOINT 2
+#define TOTAL_STYLES   3
+
+//One 8x8 block per style and combination of direction bits, stored
+//top row first
+static unsigned int blockPixels[TOTAL_STYLES][ALL_DIRECTIONS+1]
+                               [PIXELS_IN_BLOCK];
+static int blocksLoaded = FALSE;
+
+//Grid offsets (row*columns + column) of cells to redraw, unless
+//allDirty says to redraw every cell
+static size_t* dirtyCells = NULL;
+static size_t dirtyCount = 0, dirtyCapacity = 0;
+static int allDirty = FALSE;
+
+static void makeBlock(int directions, unsigned int* block);
+static int printAllRows(FILE* bmpPixelMap);
+static void makeStyles(void);
+static int cellStyle(unsigned char cell, int isWayPoint);
+static void renderBlockRow(unsigned char cell, int isWayPoint, int k,
+                           unsigned char* dest);
+
+/********************************************************************
+* loadMazeBlocks reads the sixteen mazeBitMapN.bmp blocks into
+* blockPixels. Blocks that have no file on disk are drawn from their
+* direction bits instead, in the same colors as the files.
+*
+* Must be called before any thread starts rendering. Later calls do
+* nothing.
+********************************************************************/
+void loadMazeBlocks(void)
+{ if(blocksLoaded)
+  { return;
+  }
+  int n,k,m,p;
+  char fileName[32];
+  unsigned char mazeBlockBuffer[BMP_BLOCK_SIZE];
+  for(n=0; n<=ALL_DIRECTIONS; ++n)
+  { sprintf(fileName, "mazeBitMap%d.bmp", n);
+    FILE* mazeBlock = fopen(fileName, "rb");
+    if(mazeBlock == NULL)
+    { makeBlock(n, blockPixels[STYLE_PLAIN][n]);
+      continue;
+    }
+    size_t got = fread(mazeBlockBuffer, sizeof(unsigned char),
+                       BMP_BLOCK_SIZE, mazeBlock);
+    fclose(mazeBlock);
+    if(got != BMP_BLOCK_SIZE)
+    { makeBlock(n, blockPixels[STYLE_PLAIN][n]);
+      continue;
+    }
+
+    //bmp rows are stored bottom up, blockPixels is top down
+    unsigned char* offsetPtr = &mazeBlockBuffer[PIXEL_OFFSET];
+    for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+    { for(m=0; m<PIXELS_ON_PIECE_SIDE; ++m)
+      { unsigned int rgbInfo = 0;
+        for(p=0; p<COLOR_DEPTH_IN_BYTES; ++p)
+        { rgbInfo |= ( ( (unsigned int)*(offsetPtr+p) ) << (8*p) );
+        }
+        blockPixels[STYLE_PLAIN][n]
+                   [(PIXELS_ON_PIECE_SIDE-1-k)*PIXELS_ON_PIECE_SIDE + m]
+          = rgbInfo;
+        offsetPtr += COLOR_DEPTH_IN_BYTES;
+      }
+    }
+  }
+  makeStyles();
+  blocksLoaded = TRUE;
+}
+
+/********************************************************************
+* makeBlock draws a block with a wall border that is opened on each
+* side named in directions. Corners are always wall.
+********************************************************************/
+static void makeBlock(int directions, unsigned int* block)
+{ int k,m;
+  for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+  { for(m=0; m<PIXELS_ON_PIECE_SIDE; ++m)
+    { block[k*PIXELS_ON_PIECE_SIDE + m] =
+        blockIsWall(directions, k, m) ? WALL_COLOR : FLOOR_COLOR;
+    }
+  }
+}
+
+/********************************************************************
+* makeStyles derives the solution and waypoint blocks from the plain
+* ones. Walls are shades of gray in every block, so any pixel whose
+* red and green differ is floor and takes the highlight color.
+********************************************************************/
+static void makeStyles(void)
+{ int n,p;
+  for(n=0; n<=ALL_DIRECTIONS; ++n)
+  { for(p=0; p<PIXELS_IN_BLOCK; ++p)
+    { unsigned int color = blockPixels[STYLE_PLAIN][n][p];
+      int floor = ((color >> 16) & 0xFF) != ((color >> 8) & 0xFF);
+      blockPixels[STYLE_SOLUTION][n][p] = floor ? SOLUTION_COLOR : color;
+      blockPixels[STYLE_WAYPOINT][n][p] = floor ? WAYPOINT_COLOR : color;
+    }
+  }
+}
+
+//Solution cells are the ones mazeSolve both visited and marked GOAL,
+//which leaves out the exit of a maze that has not been solved
+static int cellStyle(unsigned char cell, int isWayPoint)
+{ if(isWayPoint)
+  { return STYLE_WAYPOINT;
+  }
+  if( (cell & (GOAL|VISITED)) == (GOAL|VISITED) )
+  { return STYLE_SOLUTION;
+  }
+  return STYLE_PLAIN;
+}
+
+//Floor color of cell, plain, solution or waypoint
+unsigned int floorColor(unsigned char cell, int isWayPoint)
+{ static const unsigned int colors[TOTAL_STYLES] =
+    {FLOOR_COLOR, SOLUTION_COLOR, WAYPOINT_COLOR};
+  return colors[cellStyle(cell, isWayPoint)];
+}
+
+/********************************************************************
+* blockIsWall returns TRUE if pixel (k,m) of the 8x8 block for a cell
+* with the given direction bits is wall: the corners always, and each
+* side that is not open. k counts rows from the top.
+********************************************************************/
+int blockIsWall(int directions, int k, int m)
+{ int last = PIXELS_ON_PIECE_SIDE-1;
+  if( (k==0 || k==last) && (m==0 || m==last) )
+  { return TRUE;
+  }
+  return (k==0 && !(directions & NORTH)) ||
+         (k==last && !(directions & SOUTH)) ||
+         (m==0 && !(directions & WEST)) ||
+         (m==last && !(directions & EAST));
+}
+
+//Color of pixel (k,m) of the block drawn for cell, k counting rows
+//from the top
+unsigned int cellPixel(unsigned char cell, int isWayPoint, int k, int m)
+{ return blockPixels[cellStyle(cell, isWayPoint)][cell & ALL_DIRECTIONS]
+                    [k*PIXELS_ON_PIECE_SIDE + m];
+}
+
+//Writes the 24 bit pixels of row k of the block drawn for cell
+static void renderBlockRow(unsigned char cell, int isWayPoint, int k,
+                           unsigned char* dest)
+{ const unsigned int* src =
+    &blockPixels[cellStyle(cell, isWayPoint)][cell & ALL_DIRECTIONS]
+                [k*PIXELS_ON_PIECE_SIDE];
+  int m;
+  for(m=0; m<PIXELS_ON_PIECE_SIDE; ++m)
+  { dest[0] = (unsigned char)(src[m]);
+    dest[1] = (unsigned char)(src[m] >> 8);
+    dest[2] = (unsigned char)(src[m] >> 16);
+    dest += COLOR_DEPTH_IN_BYTES;
+  }
+}
+
+/********************************************************************
+* Helpers for 24 bit bmp images of any size. Rows are padded to a
+* multiple of 4 bytes as the format requires.
+********************************************************************/
+size_t imageRowBytes(int pixelWidth)
+{ return ((size_t)pixelWidth*COLOR_DEPTH_IN_BYTES + 3) & ~(size_t)3;
+}
+
+size_t imageFileSize(int pixelWidth, int pixelHeight)
+{ return PIXEL_OFFSET + imageRowBytes(pixelWidth)*pixelHeight;
+}
+
+//Writes the header and zeroes the row padding
+void imageHeader(unsigned char* out, int pixelWidth, int pixelHeight)
+{ struct headerBMP header;
+  makeSimpleHeader(&header, pixelWidth, pixelHeight, 24);
+  header.imageByteSize = imageRowBytes(pixelWidth)*pixelHeight;
+  header.bmpSize = header.imageByteSize + PIXEL_OFFSET;
+  packHeader(&header, (char*)out);
+  size_t pad = imageRowBytes(pixelWidth) - 
+               (size_t)pixelWidth*COLOR_DEPTH_IN_BYTES;
+  if(pad > 0)
+  { int y;
+    for(y=0; y<pixelHeight; ++y)
+    { memset(imagePixel(out, pixelWidth, pixelHeight, pixelWidth, y), 0, pad);
+    }
+  }
+}
+
+//Offset in the file of pixel (x,y), y counted from the top of the image
+size_t imageOffset(int pixelWidth, int pixelHeight, int x, int y)
+{ return PIXEL_OFFSET + imageRowBytes(pixelWidth)*(pixelHeight-1-y) +
+         (size_t)x*COLOR_DEPTH_IN_BYTES;
+}
+
+//Address of pixel (x,y), y counted from the top of the image
+unsigned char* imagePixel(unsigned char* out, int pixelWidth,
+                          int pixelHeight, int x, int y)
+{ return out + imageOffset(pixelWidth, pixelHeight, x, y);
+}
+
+/********************************************************************
+* mazeImageSize returns the number of bytes in the bmp file, header
+* included, for a grid of gridRows by gridColumns (border included).
+* Rows of a 24 bit image with 8 pixel blocks are always a multiple of
+* 4 bytes, so there is no row padding.
+********************************************************************/
+size_t mazeImageSize(int gridRows, int gridColumns)
+{ return imageFileSize((gridColumns-2)*PIXELS_ON_PIECE_SIDE,
+                       (gridRows-2)*PIXELS_ON_PIECE_SIDE);
+}
+
+/********************************************************************
+* renderMazeImage writes a complete bmp file image of the maze into
+* out, which must hold mazeImageSize(gridRows, gridColumns) bytes.
+*
+* Params:
+*   cells: row-major grid of gridRows*gridColumns cells, border included
+*   gridRows, gridColumns: grid dimensions, border included
+*   wayRow, wayColumn: the waypoint cell, drawn in its own color
+*   out: destination buffer
+********************************************************************/
+void renderMazeImage(const unsigned char* cells, int gridRows,
+                     int gridColumns, int wayRow, int wayColumn,
+                     unsigned char* out)
+{ int pixelMapRows = (gridRows-2)*PIXELS_ON_PIECE_SIDE;
+  int pixelMapCols = (gridColumns-2)*PIXELS_ON_PIECE_SIDE;
+  imageHeader(out, pixelMapCols, pixelMapRows);
+
+  //Cell row i covers image rows counted from the bottom of the file
+  int i,j,k;
+  for(i=1; i<gridRows-1; ++i)
+  { const unsigned char* row = cells + (size_t)i*gridColumns;
+    for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+    { int pixelRow = (i-1)*PIXELS_ON_PIECE_SIDE + k;
+      unsigned char* dest = imagePixel(out, pixelMapCols, pixelMapRows,
+                                       0, pixelRow);
+      for(j=1; j<gridColumns-1; ++j)
+      { renderBlockRow(row[j], i == wayRow && j == wayColumn, k, dest);
+        dest += PIXELS_ON_PIECE_SIDE*COLOR_DEPTH_IN_BYTES;
+      }
+    }
+  }
+}
+
+/********************************************************************
+* markDirty remembers that the block of the cell at row, col has to be
+* redrawn. Cells may be marked more than once, so when the list grows
+* past the number of cells, or cannot grow, everything is marked
+* instead and the list is dropped.
+********************************************************************/
+void markDirty(int row, int col)
+{ if(allDirty)
+  { return;
+  }
+  if(dirtyCount == dirtyCapacity)
+  { size_t capacity = dirtyCapacity ? 2*dirtyCapacity : 1024;
+    size_t* cells = NULL;
+    if(dirtyCount < (size_t)(rows-2)*(columns-2))
+    { cells = realloc(dirtyCells, capacity*sizeof(size_t));
+    }
+    if(cells == NULL)
+    { releaseDirty();
+      allDirty = TRUE;
+      return;
+    }
+    dirtyCells = cells;
+    dirtyCapacity = capacity;
+  }
+  dirtyCells[dirtyCount++] = (size_t)row*columns + col;
+}
+
+//Forgets all dirty cells, after a full render or a new maze
+void clearDirty(void)
+{ dirtyCount = 0;
+  allDirty = FALSE;
+}
+
+//Forgets all dirty cells and frees the list, for mazeFree
+void releaseDirty(void)
+{ free(dirtyCells);
+  dirtyCells = NULL;
+  dirtyCount = 0;
+  dirtyCapacity = 0;
+  allDirty = FALSE;
+}
+
+/********************************************************************
+* mazeRender draws the current maze, solution and waypoint included,
+* as a complete bmp file image in a new buffer, which the caller
+* frees. The size of the image is stored in imageSize.
+*
+* Returns the image, or NULL if there is no maze or no memory for the
+*   image.
+********************************************************************/
+unsigned char* mazeRender(size_t* imageSize)
+{ if(maze == NULL)
+  { printf("ERROR: No maze to render\n");
+    return NULL;
+  }
+  *imageSize = mazeImageSize(rows, columns);
+  unsigned char* image = malloc(*imageSize);
+  if(image == NULL)
+  { printf("ERROR: Maze image too large\n");
+    return NULL;
+  }
+  loadMazeBlocks();
+  renderMazeImage(*maze, rows, columns, wayY, wayX, image);
+  clearDirty();
+  return image;
+}
+
+/********************************************************************
+* mazeRenderChanges redraws only the dirty cells of the current maze
+* in image, which must be an image of this maze from mazeRender. The
+* work is 8 block rows per dirty cell, so after mazeSolve it is
+* proportional to the length of the solution, not the maze. When every
+* cell is dirty the whole image is drawn again.
+********************************************************************/
+void mazeRenderChanges(unsigned char* image)
+{ if(maze == NULL)
+  { printf("ERROR: No maze to render\n");
+    return;
+  }
+  int pixelMapRows = (rows-2)*PIXELS_ON_PIECE_SIDE;
+  int pixelMapCols = (columns-2)*PIXELS_ON_PIECE_SIDE;
+  loadMazeBlocks();
+  if(allDirty)
+  { renderMazeImage(*maze, rows, columns, wayY, wayX, image);
+    clearDirty();
+    return;
+  }
+  size_t n;
+  int k;
+  for(n=0; n<dirtyCount; ++n)
+  { int i = (int)(dirtyCells[n] / columns), j = (int)(dirtyCells[n] % columns);
+    for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+    { renderBlockRow(maze[i][j], i == wayY && j == wayX, k,
+                     imagePixel(image, pixelMapCols, pixelMapRows,
+                                (j-1)*PIXELS_ON_PIECE_SIDE,
+                                (i-1)*PIXELS_ON_PIECE_SIDE + k));
+    }
+  }
+  clearDirty();
+}
+
+/********************************************************************
+* mazePrintChanges does what mazeRenderChanges does to a bmp file
+* written by mazePrint for the current maze, such as maze.bmp,
+* rewriting one 24 byte block row at a time in place.
+*
+* Returns TRUE if the file cannot be opened or is not the size of
+* this maze. The dirty cells are kept then, for another try.
+********************************************************************/
+int mazePrintChanges(const char* fileName)
+{ if(maze == NULL)
+  { printf("ERROR: No maze to print\n");
+    return TRUE;
+  }
+  int pixelMapRows = (rows-2)*PIXELS_ON_PIECE_SIDE;
+  int pixelMapCols = (columns-2)*PIXELS_ON_PIECE_SIDE;
+  FILE* bmpPixelMap = fopen(fileName, "r+b");
+  if(bmpPixelMap == NULL)
+  { printf("ERROR: Could not open %s for writing\n", fileName);
+    return TRUE;
+  }
+  //Width and height are the little endian ints at bytes 18 and 22
+  unsigned char header[PIXEL_OFFSET];
+  unsigned int size[2] = {0, 0};
+  int p;
+  if(fread(header, sizeof(unsigned char), PIXEL_OFFSET, bmpPixelMap)
+     == PIXEL_OFFSET)
+  { for(p=3; p>=0; --p)
+    { size[0] = (size[0] << 8) | header[18+p];
+      size[1] = (size[1] << 8) | header[22+p];
+    }
+  }
+  if(size[0] != (unsigned int)pixelMapCols ||
+     size[1] != (unsigned int)pixelMapRows)
+  { printf("ERROR: %s is not an image of this maze\n", fileName);
+    fclose(bmpPixelMap);
+    return TRUE;
+  }
+
+  loadMazeBlocks();
+  unsigned char blockRow[PIXELS_ON_PIECE_SIDE*COLOR_DEPTH_IN_BYTES];
+  int failed = allDirty ? printAllRows(bmpPixelMap) : FALSE;
+  size_t n;
+  int k;
+  for(n=0; n<dirtyCount && !failed; ++n)
+  { int i = (int)(dirtyCells[n] / columns), j = (int)(dirtyCells[n] % columns);
+    for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+    { renderBlockRow(maze[i][j], i == wayY && j == wayX, k, blockRow);
+      long offset = (long)imageOffset(pixelMapCols, pixelMapRows,
+                                      (j-1)*PIXELS_ON_PIECE_SIDE,
+                                      (i-1)*PIXELS_ON_PIECE_SIDE + k);
+      if(fseek(bmpPixelMap, offset, SEEK_SET) != 0 ||
+         fwrite(blockRow, sizeof(blockRow), 1, bmpPixelMap) != 1)
+      { failed = TRUE;
+        break;
+      }
+    }
+  }
+  if(fclose(bmpPixelMap) != 0)
+  { failed = TRUE;
+  }
+  if(failed)
+  { printf("ERROR: Could not write %s\n", fileName);
+    return TRUE;
+  }
+  clearDirty();
+  return FALSE;
+}
+
+/********************************************************************
+* printAllRows rewrites every pixel row of an image file of the
+* current maze, for mazePrintChanges when every cell is dirty. One
+* pixel row is built and written at a time.
+*
+* Returns TRUE if the file could not be written.
+********************************************************************/
+static int printAllRows(FILE* bmpPixelMap)
+{ int pixelMapRows = (rows-2)*PIXELS_ON_PIECE_SIDE;
+  int pixelMapCols = (columns-2)*PIXELS_ON_PIECE_SIDE;
+  size_t lineBytes = (size_t)pixelMapCols*COLOR_DEPTH_IN_BYTES;
+  unsigned char* line = malloc(lineBytes);
+  if(line == NULL)
+  { return TRUE;
+  }
+  int failed = FALSE;
+  int i,j,k;
+  for(i=1; i<rows-1 && !failed; ++i)
+  { for(k=0; k<PIXELS_ON_PIECE_SIDE; ++k)
+    { for(j=1; j<columns-1; ++j)
+      { renderBlockRow(maze[i][j], i == wayY && j == wayX, k,
+                       line + (size_t)(j-1)*PIXELS_ON_PIECE_SIDE*
+                              COLOR_DEPTH_IN_BYTES);
+      }
+      long offset = (long)imageOffset(pixelMapCols, pixelMapRows, 0,
+                                      (i-1)*PIXELS_ON_PIECE_SIDE + k);
+      if(fseek(bmpPixelMap, offset, SEEK_SET) != 0 ||
+         fwrite(line, lineBytes, 1, bmpPixelMap) != 1)
+      { failed = TRUE;
+        break;
+      }
+    }
+  }
+  free(line);
+  return failed;
+}
@@ -0,0 +1,506 @@
+/********************************************************************
+* Maze Server
+*
+* A small daemon that hands out ready made mazes over a Unix domain
+* socket, so that requests do not wait for a maze to be carved.
+*
+* Usage: mazeserver socketPath poolDepth workers WxH [WxH ...] [-r]
+*
+* Every WxH is a size class with a pool of up to poolDepth mazes,
+* waypoint in the middle, that workers threads keep topped up in the
+* background. With -r the pooled mazes are rendered ahead of time as
+* well, otherwise images are rendered when asked for.
+*
+* Protocol: one request per line, any number per connection.
+*
+*   MAZE w h    ->  OK n, newline, then n = (w+2)*(h+2) cells of the
+*                   grid row by row, border included, bits as in
+*                   mazegen.h
+*   IMAGE w h   ->  OK n, newline, then the n bytes of a bmp file
+*   STATS       ->  OK n, newline, then n bytes of text counters
+*
+* Errors are answered with ERROR and a message on one line. Sizes that
+* are not a size class, and classes whose pool is empty, are ordered
+* from the workers, which take orders ahead of refills. Sizes go up to
+* the size of the largest class.
+*
+* carveMaze recurses once per cell of the carve, so only the workers
+* carve, on stacks sized for the largest class. Connection threads
+* keep the default stack.
+*
+* mazeGenerate works on one global model, so only one thread carves at
+* a time (under carveLock). Workers copy each maze out of the model and
+* render from their copy, and connection threads render from pooled
+* copies, so rendering and sending never hold the carve lock.
+********************************************************************/
+
+/* Includes */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+
+const int DIRECTION_LIST[] = {NORTH, EAST, SOUTH, WEST};
+const int DIRECTION_DX[]   = {    0,    1,     0,   -1};
+const int DIRECTION_DY[]   = {   -1,    0,     1,    0};
+
+
+const unsigned char pipeList[] =
+{
+  219, 208, 198, 200, 210, 186, 201, 204,
+  181, 188, 205, 202, 187, 185, 203, 206
+};
+
+//Not used by the server, the library only needs it to be defined
+void textcolor(int color)
+{ (void)color;
+}
+
+#define REQUEST_LINE 128
+
+struct pooledMaze {
+  unsigned char* cells;  //grid copy, border included
+  unsigned char* image;  //bmp file, or NULL if not rendered yet
+  size_t imageSize;
+};
+
+struct sizeClass {
+  int width, height;
+  struct pooledMaze* slots;  //ring of poolDepth mazes
+  int head, count;
+  int pending;               //mazes being made for this pool
+};
+
+//A maze a connection waits for, made by a worker
+struct order {
+  int width, height;
+  struct pooledMaze made;
+  int done;
+  struct order* next;
+};
+
+struct connection {
+  int fd;
+  char buffer[REQUEST_LINE];
+  size_t start, end;         //unread bytes of buffer
+};
+
+static struct sizeClass* classes;
+static int classCount;
+static int poolDepth;
+static int preRender = FALSE;
+static size_t largestClass = 0;   //cells in the largest size class
+
+static pthread_mutex_t poolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t poolShort = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t orderDone = PTHREAD_COND_INITIALIZER;
+static struct order* orders = NULL;  //first in, first out, under poolLock
+static pthread_mutex_t carveLock = PTHREAD_MUTEX_INITIALIZER;
+
+//Counters, under poolLock
+static unsigned long served = 0, poolHits = 0, poolMisses = 0;
+static unsigned long generated = 0;
+
+static int makeMaze(int width, int height, struct pooledMaze* made);
+static int renderPooled(int width, int height, struct pooledMaze* made);
+static struct sizeClass* findClass(int width, int height);
+static void* refillWorker(void* arg);
+static void* serveConnection(void* arg);
+static int answer(struct connection* client, const char* request);
+static int readLine(struct connection* client, char* line);
+static int sendReply(int fd, const unsigned char* data, size_t size);
+static int sendError(int fd, const char* message);
+static int writeAll(int fd, const unsigned char* buffer, size_t size);
+
+
+int main(int argc, char** argv)
+{ if(argc < 5)
+  { printf("Usage: %s socketPath poolDepth workers WxH [WxH ...] [-r]\n",
+           argv[0]);
+    return TRUE;
+  }
+  const char* socketPath = argv[1];
+  poolDepth = atoi(argv[2]);
+  int workers = atoi(argv[3]);
+  if(poolDepth < 1 || workers < 1)
+  { printf("ERROR: poolDepth and workers must be at least 1\n");
+    return TRUE;
+  }
+  classes = calloc((size_t)argc, sizeof(struct sizeClass));
+  int a;
+  for(a=4; a<argc; ++a)
+  { if(strcmp(argv[a], "-r") == 0)
+    { preRender = TRUE;
+      continue;
+    }
+    struct sizeClass* class = &classes[classCount];
+    if(sscanf(argv[a], "%dx%d", &class->width, &class->height) != 2 ||
+       class->width < 3 || class->height < 3)
+    { printf("ERROR: Bad size class %s\n", argv[a]);
+      return TRUE;
+    }
+    class->slots = calloc((size_t)poolDepth, sizeof(struct pooledMaze));
+    if((size_t)class->width*class->height > largestClass)
+    { largestClass = (size_t)class->width*class->height;
+    }
+    ++classCount;
+  }
+  if(classCount == 0)
+  { printf("ERROR: No size classes given\n");
+    return TRUE;
+  }
+
+  srand((unsigned)time(NULL));
+  loadMazeBlocks();
+  signal(SIGPIPE, SIG_IGN);
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  struct sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if(listener < 0 || strlen(socketPath) >= sizeof(address.sun_path))
+  { printf("ERROR: Could not make socket %s\n", socketPath);
+    return TRUE;
+  }
+  strcpy(address.sun_path, socketPath);
+  unlink(socketPath);
+  if(bind(listener, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+     listen(listener, 64) != 0)
+  { printf("ERROR: Could not listen on %s\n", socketPath);
+    return TRUE;
+  }
+
+  pthread_attr_t carveThread, plainThread;
+  pthread_attr_init(&carveThread);
+  pthread_attr_setdetachstate(&carveThread, PTHREAD_CREATE_DETACHED);
+  size_t stackSize = largestClass*MAZE_STACK_PER_CELL;
+  if(stackSize < MAZE_STACK_MINIMUM)
+  { stackSize = MAZE_STACK_MINIMUM;
+  }
+  pthread_attr_setstacksize(&carveThread, stackSize);
+  pthread_attr_init(&plainThread);
+  pthread_attr_setdetachstate(&plainThread, PTHREAD_CREATE_DETACHED);
+  int w;
+  for(w=0; w<workers; ++w)
+  { pthread_t thread;
+    if(pthread_create(&thread, &carveThread, refillWorker, NULL) != 0)
+    { printf("ERROR: Could not start worker threads\n");
+      return TRUE;
+    }
+  }
+  printf("Serving %d size classes on %s\n", classCount, socketPath);
+
+  while(TRUE)
+  { int fd = accept(listener, NULL, NULL);
+    if(fd < 0)
+    { if(errno == EINTR) continue;
+      printf("ERROR: accept failed\n");
+      break;
+    }
+    struct connection* client = calloc(1, sizeof(struct connection));
+    if(client == NULL)
+    { close(fd);
+      continue;
+    }
+    client->fd = fd;
+    pthread_t thread;
+    if(pthread_create(&thread, &plainThread, serveConnection, client) != 0)
+    { close(fd);
+      free(client);
+      continue;
+    }
+  }
+  close(listener);
+  unlink(socketPath);
+  return FALSE;
+}
+
+/********************************************************************
+* makeMaze carves a width by height maze, waypoint in the middle, and
+* copies its grid into made. Holds carveLock only while the global
+* model is in use.
+*
+* Returns TRUE, with made->cells NULL, if there is not enough memory.
+********************************************************************/
+static int makeMaze(int width, int height, struct pooledMaze* made)
+{ size_t gridSize = (size_t)(width+2)*(height+2);
+  made->cells = malloc(gridSize);
+  made->image = NULL;
+  made->imageSize = 0;
+  if(made->cells == NULL)
+  { return TRUE;
+  }
+  pthread_mutex_lock(&carveLock);
+  if(mazeGenerate(width, height, (width+1)/2, (height+1)/2,
+                  0, 0.0, 0.0, FALSE))
+  { pthread_mutex_unlock(&carveLock);
+    free(made->cells);
+    made->cells = NULL;
+    return TRUE;
+  }
+  memcpy(made->cells, *maze, gridSize);
+  pthread_mutex_unlock(&carveLock);
+  return FALSE;
+}
+
+//Renders the bmp image of made from its own grid copy. Returns TRUE,
+//  with made->image NULL, if there is not enough memory
+static int renderPooled(int width, int height, struct pooledMaze* made)
+{ made->imageSize = mazeImageSize(height+2, width+2);
+  made->image = malloc(made->imageSize);
+  if(made->image == NULL)
+  { made->imageSize = 0;
+    return TRUE;
+  }
+  renderMazeImage(made->cells, height+2, width+2, (height+1)/2,
+                  (width+1)/2, made->image);
+  return FALSE;
+}
+
+//Returns the size class for width by height, or NULL
+static struct sizeClass* findClass(int width, int height)
+{ int c;
+  for(c=0; c<classCount; ++c)
+  { if(classes[c].width == width && classes[c].height == height)
+    { return &classes[c];
+    }
+  }
+  return NULL;
+}
+
+/********************************************************************
+* refillWorker first makes the mazes connections have ordered, oldest
+* first. With no orders it waits for a pool that is short of mazes,
+* makes one for the pool that is shortest, and adds it. Pools are
+* counted with the mazes already being made for them, so workers never
+* overfill one. An order that cannot be made is handed back with no
+* cells; a refill that cannot be made is dropped, and the worker waits
+* a second before trying again.
+********************************************************************/
+static void* refillWorker(void* arg)
+{ (void)arg;
+  while(TRUE)
+  { pthread_mutex_lock(&poolLock);
+    struct sizeClass* class = NULL;
+    struct order* order = NULL;
+    while(class == NULL && order == NULL)
+    { if(orders != NULL)
+      { order = orders;
+        orders = order->next;
+        break;
+      }
+      int c, shortest = 0;
+      for(c=0; c<classCount; ++c)
+      { int missing = poolDepth - classes[c].count - classes[c].pending;
+        if(missing > shortest)
+        { shortest = missing;
+          class = &classes[c];
+        }
+      }
+      if(class == NULL)
+      { pthread_cond_wait(&poolShort, &poolLock);
+      }
+    }
+    if(order != NULL)
+    { pthread_mutex_unlock(&poolLock);
+      makeMaze(order->width, order->height, &order->made);
+      pthread_mutex_lock(&poolLock);
+      order->done = TRUE;
+      ++generated;
+      pthread_cond_broadcast(&orderDone);
+      pthread_mutex_unlock(&poolLock);
+      continue;
+    }
+    ++class->pending;
+    pthread_mutex_unlock(&poolLock);
+
+    struct pooledMaze made;
+    if(makeMaze(class->width, class->height, &made))
+    { printf("ERROR: Not enough memory to refill the %dx%d pool\n",
+             class->width, class->height);
+      pthread_mutex_lock(&poolLock);
+      --class->pending;
+      pthread_mutex_unlock(&poolLock);
+      sleep(1);
+      continue;
+    }
+    //Without room for the image it is rendered when asked for instead
+    if(preRender)
+    { renderPooled(class->width, class->height, &made);
+    }
+
+    pthread_mutex_lock(&poolLock);
+    class->slots[(class->head + class->count) % poolDepth] = made;
+    ++class->count;
+    --class->pending;
+    ++generated;
+    pthread_mutex_unlock(&poolLock);
+  }
+  return NULL;
+}
+
+//Answers requests on one connection until the client hangs up
+static void* serveConnection(void* arg)
+{ struct connection* client = arg;
+  char line[REQUEST_LINE];
+  while(readLine(client, line) == FALSE)
+  { if(answer(client, line))
+    { break;
+    }
+  }
+  close(client->fd);
+  free(client);
+  return NULL;
+}
+
+/********************************************************************
+* answer handles one request line. A maze of a size class comes out of
+* its pool when there is one ready, and the pool is flagged for
+* refill; otherwise it is ordered from the workers and waited for.
+*
+* Returns TRUE if the connection should be closed.
+********************************************************************/
+static int answer(struct connection* client, const char* request)
+{ char kind[16];
+  int width, height;
+  if(strcmp(request, "STATS") == 0)
+  { char text[256];
+    pthread_mutex_lock(&poolLock);
+    int ready = 0, c;
+    for(c=0; c<classCount; ++c)
+    { ready += classes[c].count;
+    }
+    int length = snprintf(text, sizeof(text),
+      "served %lu\npool hits %lu\npool misses %lu\ngenerated %lu\n"
+      "ready %d\n", served, poolHits, poolMisses, generated, ready);
+    pthread_mutex_unlock(&poolLock);
+    return sendReply(client->fd, (unsigned char*)text, (size_t)length);
+  }
+  if(sscanf(request, "%15s %d %d", kind, &width, &height) != 3 ||
+     (strcmp(kind, "MAZE") != 0 && strcmp(kind, "IMAGE") != 0))
+  { return sendError(client->fd, "unknown request");
+  }
+  if(width < 3 || height < 3 || (size_t)width*height > largestClass)
+  { return sendError(client->fd, "size out of range");
+  }
+
+  struct pooledMaze taken;
+  struct sizeClass* class = findClass(width, height);
+  pthread_mutex_lock(&poolLock);
+  if(class != NULL && class->count > 0)
+  { taken = class->slots[class->head];
+    class->head = (class->head + 1) % poolDepth;
+    --class->count;
+    ++poolHits;
+    pthread_cond_signal(&poolShort);
+  }
+  else
+  { //Join the back of the queue and wake every worker, one takes it
+    struct order order = { width, height, { NULL, NULL, 0 }, FALSE, NULL };
+    struct order** last = &orders;
+    while(*last != NULL)
+    { last = &(*last)->next;
+    }
+    *last = &order;
+    ++poolMisses;
+    pthread_cond_broadcast(&poolShort);
+    while(!order.done)
+    { pthread_cond_wait(&orderDone, &poolLock);
+    }
+    taken = order.made;
+  }
+  if(taken.cells != NULL)
+  { ++served;
+  }
+  pthread_mutex_unlock(&poolLock);
+  if(taken.cells == NULL)
+  { return sendError(client->fd, "out of memory");
+  }
+
+  int failed;
+  if(strcmp(kind, "MAZE") == 0)
+  { failed = sendReply(client->fd, taken.cells,
+                       (size_t)(width+2)*(height+2));
+  }
+  else if(taken.image == NULL && renderPooled(width, height, &taken))
+  { failed = sendError(client->fd, "out of memory");
+  }
+  else
+  { failed = sendReply(client->fd, taken.image, taken.imageSize);
+  }
+  free(taken.cells);
+  free(taken.image);
+  return failed;
+}
+
+/********************************************************************
+* readLine reads the next request line into line, without its line
+* end. Returns TRUE on end of file, error, or a line too long.
+********************************************************************/
+static int readLine(struct connection* client, char* line)
+{ while(TRUE)
+  { char* end = memchr(client->buffer + client->start, '\n',
+                       client->end - client->start);
+    if(end != NULL)
+    { size_t length = (size_t)(end - (client->buffer + client->start));
+      memcpy(line, client->buffer + client->start, length);
+      line[length] = '\0';
+      if(length > 0 && line[length-1] == '\r') line[length-1] = '\0';
+      client->start += length + 1;
+      return FALSE;
+    }
+    //Move what is left to the front and read more behind it
+    memmove(client->buffer, client->buffer + client->start,
+            client->end - client->start);
+    client->end -= client->start;
+    client->start = 0;
+    if(client->end == sizeof(client->buffer))
+    { return TRUE;
+    }
+    ssize_t got = read(client->fd, client->buffer + client->end,
+                       sizeof(client->buffer) - client->end);
+    if(got < 0 && errno == EINTR) continue;
+    if(got <= 0)
+    { return TRUE;
+    }
+    client->end += (size_t)got;
+  }
+}
+
+//Sends OK, the byte count, then the bytes. Returns TRUE on error
+static int sendReply(int fd, const unsigned char* data, size_t size)
+{ char header[32];
+  int length = snprintf(header, sizeof(header), "OK %zu\n", size);
+  return writeAll(fd, (unsigned char*)header, (size_t)length) ||
+         writeAll(fd, data, size);
+}
+
+//Sends an ERROR line. Returns TRUE on error
+static int sendError(int fd, const char* message)
+{ char line[REQUEST_LINE];
+  int length = snprintf(line, sizeof(line), "ERROR %s\n", message);
+  return writeAll(fd, (unsigned char*)line, (size_t)length);
+}
+
+//Writes the whole buffer, looping on short writes. Returns TRUE on error
+static int writeAll(int fd, const unsigned char* buffer, size_t size)
+{ while(size > 0)
+  { ssize_t done = write(fd, buffer, size);
+    if(done < 0 && errno == EINTR) continue;
+    if(done <= 0)
+    { return TRUE;
+    }
+    buffer += done;
+    size -= (size_t)done;
+  }
+  return FALSE;
+}
@@ -0,0 +1,201 @@
+/********************************************************************
+* Disk Backed Maze Storage
+*
+* Lets the maze grid live in a memory mapped file instead of on the
+* heap, for mazes too large to fit in memory. The page cache then
+* decides what is resident, and the carving and sweeps in mazegen.c
+* tell it what they are about to use and what they are done with
+* through adviseRows.
+*
+* File layout: one page holding a mazeFileHeader, then the grid of
+* rows*columns cells exactly as it is held in memory. The file is a
+* complete maze once mazeGenerate returns, and mazeOpen can map it
+* again later without regenerating.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define MAZE_FILE_MAGIC "MAZEGRID"
+#define MAZE_FILE_VERSION 1
+
+struct mazeFileHeader {
+  char magic[8];
+  int version;
+  int rows, columns;
+  int wayX, wayY;
+};
+
+static char* storageName = NULL;   //file for the next mazeGenerate
+static int mappedFile = -1;
+static unsigned char* mappedBase = NULL;
+static size_t mappedSize = 0;
+static size_t pageSize = 0;
+
+static size_t headerBytes(void);
+
+/********************************************************************
+* mazeStorage picks where the grid of every following mazeGenerate is
+* kept: in the named file, which is created or overwritten, or on the
+* heap if fileName is NULL.
+********************************************************************/
+void mazeStorage(const char* fileName)
+{ free(storageName);
+  storageName = NULL;
+  if(fileName != NULL)
+  { storageName = malloc(strlen(fileName) + 1);
+    if(storageName == NULL)
+    { printf("ERROR: Not enough memory, the maze stays on the heap\n");
+      return;
+    }
+    strcpy(storageName, fileName);
+  }
+}
+
+//Returns TRUE if mazeGenerate should map its grid from a file
+int storageSelected(void)
+{ return storageName != NULL;
+}
+
+//The header takes one whole page so the cells start page aligned
+static size_t headerBytes(void)
+{ if(pageSize == 0)
+  { pageSize = (size_t)sysconf(_SC_PAGESIZE);
+  }
+  return pageSize;
+}
+
+/********************************************************************
+* createMappedGrid sizes the storage file for a grid of gridRows by
+* gridColumns cells and maps it. New cells read as NO_DIRECTIONS.
+*
+* Returns the first cell, or NULL if the file could not be made.
+********************************************************************/
+unsigned char* createMappedGrid(int gridRows, int gridColumns)
+{ int fd = open(storageName, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if(fd < 0)
+  { return NULL;
+  }
+  size_t size = headerBytes() + (size_t)gridRows*gridColumns;
+  if(ftruncate(fd, (off_t)size) != 0)
+  { close(fd);
+    return NULL;
+  }
+  void* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if(base == MAP_FAILED)
+  { close(fd);
+    return NULL;
+  }
+  mappedFile = fd;
+  mappedBase = base;
+  mappedSize = size;
+
+  struct mazeFileHeader* header = (struct mazeFileHeader*)mappedBase;
+  memcpy(header->magic, MAZE_FILE_MAGIC, sizeof(header->magic));
+  header->version = MAZE_FILE_VERSION;
+  header->rows = gridRows;
+  header->columns = gridColumns;
+  header->wayX = 0;
+  header->wayY = 0;
+  return mappedBase + headerBytes();
+}
+
+/********************************************************************
+* openMappedGrid maps a file written by an earlier mazeGenerate and
+* sets rows, columns, wayX and wayY from its header.
+*
+* Returns the first cell, or NULL if the file is missing or is not a
+* complete maze file.
+********************************************************************/
+unsigned char* openMappedGrid(const char* fileName)
+{ int fd = open(fileName, O_RDWR);
+  if(fd < 0)
+  { return NULL;
+  }
+  struct stat info;
+  struct mazeFileHeader header;
+  if(fstat(fd, &info) != 0 || (size_t)info.st_size < headerBytes() ||
+     pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+     memcmp(header.magic, MAZE_FILE_MAGIC, sizeof(header.magic)) != 0 ||
+     header.version != MAZE_FILE_VERSION || header.rows < 5 ||
+     header.columns < 5 || header.wayX <= 0 || header.wayY <= 0 ||
+     (size_t)info.st_size != headerBytes() +
+                             (size_t)header.rows*header.columns)
+  { close(fd);
+    return NULL;
+  }
+  void* base = mmap(NULL, (size_t)info.st_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+  if(base == MAP_FAILED)
+  { close(fd);
+    return NULL;
+  }
+  mappedFile = fd;
+  mappedBase = base;
+  mappedSize = (size_t)info.st_size;
+  rows = header.rows;
+  columns = header.columns;
+  wayX = header.wayX;
+  wayY = header.wayY;
+  return mappedBase + headerBytes();
+}
+
+/********************************************************************
+* finishMappedGrid records the waypoint in the header, which marks
+* the file as a complete maze, and starts writing it back.
+********************************************************************/
+void finishMappedGrid(void)
+{ if(mappedBase == NULL)
+  { return;
+  }
+  struct mazeFileHeader* header = (struct mazeFileHeader*)mappedBase;
+  header->wayX = wayX;
+  header->wayY = wayY;
+  msync(mappedBase, mappedSize, MS_ASYNC);
+}
+
+//Unmaps the grid file. Safe to call when nothing is mapped
+void releaseMappedGrid(void)
+{ if(mappedBase == NULL)
+  { return;
+  }
+  msync(mappedBase, mappedSize, MS_SYNC);
+  munmap(mappedBase, mappedSize);
+  close(mappedFile);
+  mappedBase = NULL;
+  mappedSize = 0;
+  mappedFile = -1;
+}
+
+/********************************************************************
+* adviseRows tells the kernel how grid rows first to last are about to
+* be used (one of the ROWS_* hints). Does nothing for a grid on the
+* heap. Rows that are done are queued for writing first: on a shared
+* file mapping dropping the pages only lets them go from memory, the
+* data stays in the file.
+********************************************************************/
+void adviseRows(int first, int last, int hint)
+{ if(mappedBase == NULL || first > last)
+  { return;
+  }
+  int advice = MADV_NORMAL;
+  if(hint == ROWS_SEQUENTIAL) advice = MADV_SEQUENTIAL;
+  if(hint == ROWS_NEEDED) advice = MADV_WILLNEED;
+  if(hint == ROWS_DONE) advice = MADV_DONTNEED;
+
+  unsigned char* start = mappedBase + headerBytes() + (size_t)first*columns;
+  unsigned char* end = mappedBase + headerBytes() + (size_t)(last+1)*columns;
+  //madvise needs a page aligned start
+  start = mappedBase + ((size_t)(start - mappedBase) / pageSize)*pageSize;
+  if(advice == MADV_DONTNEED)
+  { msync(start, (size_t)(end - start), MS_ASYNC);
+  }
+  madvise(start, (size_t)(end - start), advice);
+}
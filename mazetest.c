@@ -4,6 +4,7 @@
 
 /* Includes */
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include "mazegen.h"
 
@@ -38,6 +39,13 @@ void textcolor(int color)
 
 
 
+//Frees a window TEST 4 expects to be refused. TRUE if one was made.
+static int windowMade(unsigned char* image)
+{ int made = image != NULL;
+  free(image);
+  return made;
+}
+
 
 int main(void)
 {
@@ -83,8 +91,6 @@ int main(void)
   //mazeSolve(); mazePrint();
 
 
-  return 0;
-
   mazeGenerate(40,22,   20,11,0,  1.0,  0.0, TRUE); 
   mazePrint();
   mazeSolve(); mazePrint();
@@ -124,6 +130,32 @@ int main(void)
     { printf("Made %d mazes so far.\n",i);
     }
     mazeGenerate(450,450,   225,225,0,  1.0,  0.0, FALSE); 
+    if(mazeValidate())
+    { printf("ERROR: Maze %d is not a valid maze\n",i);
+    }
+  }
+
+
+
+
+  printf("TEST 3b: Parallel and recarved mazes must pass mazeValidate.\n");
+
+  for (i=0; i < 20; i++)
+  { mazeGenerateParallel(450,450,   225,225,  1+i%8); 
+    if(mazeValidate())
+    { printf("ERROR: Parallel maze %d is not a valid maze\n",i);
+    }
+  }
+
+  mazeGenerate(200,150,   100,75,0,  1.0,  0.0, FALSE); 
+  for (i=0; i < 200; i++)
+  { int w = 1 + rand()%40, h = 1 + rand()%40;
+    int x = 1 + rand()%(200-w+1), y = 1 + rand()%(150-h+1);
+    mazeRecarve(x,y, w,h);
+    if(mazeValidate())
+    { printf("ERROR: Recarve %d of (%d,%d) %dx%d is not a valid maze\n",
+             i, x,y, w,h);
+    }
   }
 
 
@@ -134,6 +166,24 @@ int main(void)
   mazeGenerate(90,2,   40,1,0,  1.0,  0.0, FALSE); 
   mazeGenerate(30,30,  31,10,0,  1.0,  0.0, FALSE); 
   mazeGenerate(30,30,  15,0,0,  1.0,  0.0, FALSE); 
+
+  //Each of these must be refused, with its ERROR printed above
+  int accepted = 0;
+  accepted += !mazeGenerate(30,30,  15,10,-1, 1.0,  0.0, FALSE); 
+  accepted += !mazeGenerate(30,30,  15,10,0,  1.5,  0.0, FALSE); 
+  accepted += !mazeGenerate(30,30,  15,10,0,  1.0, -0.5, FALSE); 
+
+  mazeGenerate(30,30,  15,10,0,  1.0,  0.0, FALSE); 
+  size_t imageSize;
+  accepted += windowMade(mazeRenderWindow(0,1, 10,10, 8,2, &imageSize));
+  accepted += windowMade(mazeRenderWindow(25,25, 10,10, 8,2, &imageSize));
+  accepted += windowMade(mazeRenderWindow(1,1, 10,10, 0,2, &imageSize));
+  accepted += !mazeRecarve(0,1, 10,10);
+  accepted += !mazeRecarve(25,25, 10,10);
+  accepted += !mazeRecarve(1,1, 0,10);
+  if(accepted > 0)
+  { printf("ERROR: %d out of range cases were accepted\n", accepted);
+  }
   
   
   // Release memory
@@ -0,0 +1,204 @@
+/********************************************************************
+* Maze Path Index
+*
+* A perfect maze is a spanning tree over its cells, so there is
+* exactly one path between any two of them. mazeIndex roots that tree
+* at the entrance and keeps, for every cell:
+*
+*   parent: the next cell toward the entrance
+*   depth:  steps from the entrance
+*   jump:   an ancestor further up, chosen so that any ancestor can be
+*           reached in O(log depth) jumps and parent steps (the
+*           skew-binary jump pointers of Myers' random access lists)
+*
+* The jump pointers answer the same lowest common ancestor queries
+* binary lifting does, in O(log n), but with one pointer per cell
+* instead of log n of them. Then
+*
+*   distance(a, b) = depth[a] + depth[b] - 2*depth[lca(a, b)]
+*
+* and the path is the walk from a up to the ancestor and down to b,
+* which takes time proportional to its length.
+*
+* Cells are named by column x and row y, counted from 1 like the
+* waypoint. The index is dropped by mazeFree and by the next maze.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define NO_CELL -1
+
+//Kept together so that each step of a query touches one cache line
+struct treeNode {
+  int parent;
+  int depth;
+  int jump;
+};
+
+static struct treeNode* tree = NULL;
+
+static int cellOf(int x, int y);
+static int commonAncestor(int a, int b);
+
+/********************************************************************
+* mazeIndex builds the path index for the current maze with one
+* breadth first search from the entrance. Call it after mazeGenerate
+* (or mazeOpen), before mazeDistance and mazePath. Cells are marked
+* as they are queued, so a grid with a cycle (one that fails
+* mazeValidate) still indexes, along the first path found to each cell.
+*
+* Returns TRUE if there is no maze or not enough memory. Otherwise FALSE.
+********************************************************************/
+int mazeIndex(void)
+{ releaseIndex();
+  if(maze == NULL)
+  { printf("ERROR: No maze to index\n");
+    return TRUE;
+  }
+  size_t gridSize = (size_t)rows*columns;
+  tree = malloc(gridSize*sizeof(struct treeNode));
+  int* queue = malloc(gridSize*sizeof(int));
+  if(tree == NULL || queue == NULL)
+  { printf("ERROR: Not enough memory to index the maze\n");
+    free(queue);
+    releaseIndex();
+    return TRUE;
+  }
+  //Every byte 0xFF makes every parent NO_CELL until the search reaches it
+  memset(tree, 0xFF, gridSize*sizeof(struct treeNode));
+
+  int j;
+  for(j=1; j<columns-1; ++j)
+  { if(maze[1][j] & NORTH) break;
+  }
+  int root = columns + (j < columns-1 ? j : 1);
+  int head = 0, tail = 0;
+  queue[tail++] = root;
+  tree[root].parent = root;
+  tree[root].depth = 0;
+  tree[root].jump = root;
+  while(head < tail)
+  { int cell = queue[head++];
+    int sides = (*maze)[cell];
+    int d;
+    for(d=0; d<TOTAL_DIRECTIONS; ++d)
+    { int next = cell + DIRECTION_DY[d]*columns + DIRECTION_DX[d];
+      //A cell with a parent is already queued, the root included
+      if( !(sides & DIRECTION_LIST[d]) || tree[next].parent != NO_CELL ||
+          ((*maze)[next] & SPECIAL) )
+      { continue;
+      }
+      tree[next].parent = cell;
+      tree[next].depth = tree[cell].depth + 1;
+      //Jump twice as far when the two jumps above are the same length
+      int up = tree[cell].jump;
+      if(tree[cell].depth - tree[up].depth ==
+         tree[up].depth - tree[tree[up].jump].depth)
+      { tree[next].jump = tree[up].jump;
+      }
+      else
+      { tree[next].jump = cell;
+      }
+      queue[tail++] = next;
+    }
+  }
+  free(queue);
+  return FALSE;
+}
+
+//Frees the index. Safe to call when there is none
+void releaseIndex(void)
+{ free(tree);
+  tree = NULL;
+}
+
+/********************************************************************
+* mazeDistance returns the number of steps on the path between cells
+* (x1, y1) and (x2, y2), in O(log n).
+*
+* Returns -1 if there is no index or a cell is outside the maze or
+* not connected to the entrance.
+********************************************************************/
+int mazeDistance(int x1, int y1, int x2, int y2)
+{ int a = cellOf(x1, y1), b = cellOf(x2, y2);
+  if(a == NO_CELL || b == NO_CELL)
+  { return -1;
+  }
+  return tree[a].depth + tree[b].depth - 2*tree[commonAncestor(a, b)].depth;
+}
+
+/********************************************************************
+* mazePath writes the cells of the path from (x1, y1) to (x2, y2),
+* both included and in order, to pathX and pathY if it has no more
+* than maxCells cells. Takes time proportional to the path.
+*
+* Returns the number of cells on the path, which is more than maxCells
+* if nothing was written, or -1 if there is no index or a cell is
+* outside the maze.
+********************************************************************/
+int mazePath(int x1, int y1, int x2, int y2,
+             int* pathX, int* pathY, int maxCells)
+{ int a = cellOf(x1, y1), b = cellOf(x2, y2);
+  if(a == NO_CELL || b == NO_CELL)
+  { return -1;
+  }
+  int top = commonAncestor(a, b);
+  int count = tree[a].depth + tree[b].depth - 2*tree[top].depth + 1;
+  if(count > maxCells)
+  { return count;
+  }
+  //a's side fills in from the front, b's side from the back
+  int front = 0, back = count-1;
+  while(a != top)
+  { pathX[front] = a % columns;
+    pathY[front++] = a / columns;
+    a = tree[a].parent;
+  }
+  while(b != top)
+  { pathX[back] = b % columns;
+    pathY[back--] = b / columns;
+    b = tree[b].parent;
+  }
+  pathX[front] = top % columns;
+  pathY[front] = top / columns;
+  return count;
+}
+
+//Grid index of cell (x, y), or NO_CELL
+static int cellOf(int x, int y)
+{ if(tree == NULL || x < 1 || y < 1 || x > columns-2 || y > rows-2 ||
+     tree[y*columns + x].parent == NO_CELL)
+  { return NO_CELL;
+  }
+  return y*columns + x;
+}
+
+/********************************************************************
+* commonAncestor returns the lowest common ancestor of a and b. The
+* deeper cell is first lifted to the other's depth, then both climb
+* together, taking a jump whenever it does not meet the other side.
+********************************************************************/
+static int commonAncestor(int a, int b)
+{ if(tree[a].depth < tree[b].depth)
+  { int t = a; a = b; b = t;
+  }
+  int target = tree[b].depth;
+  while(tree[a].depth > target)
+  { a = (tree[tree[a].jump].depth >= target) ? tree[a].jump : tree[a].parent;
+  }
+  while(a != b)
+  { if(tree[a].jump != tree[b].jump)
+    { a = tree[a].jump;
+      b = tree[b].jump;
+    }
+    else
+    { a = tree[a].parent;
+      b = tree[b].parent;
+    }
+  }
+  return a;
+}
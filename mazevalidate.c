@@ -0,0 +1,175 @@
+/********************************************************************
+* Maze Validation
+*
+* mazeValidate checks that the current maze is one mazeGenerate could
+* have made, in one pass over the grid with a union-find over the
+* passages:
+*
+*   - every passage is open from both sides
+*   - nothing opens into the SPECIAL border except one entrance on
+*     the top row and one exit on the bottom row
+*   - no passage closes a loop, and every cell is connected (perfect)
+*   - the path from entrance to exit goes through the waypoint
+*
+* The waypoint check uses the tree shape: the waypoint is on the path
+* between entrance and exit exactly when those two are still apart
+* after every passage except the waypoint's own has been joined. The
+* waypoint's passages are joined last, so the loop check still sees
+* all of them.
+*
+* Cells are numbered with size_t, since file backed mazes can have more
+* of them than an int holds.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define NO_CELL ((size_t)-1)
+
+static size_t* setParent;
+static unsigned char* setRank;
+
+static size_t findSet(size_t cell);
+static int joinSets(size_t a, size_t b);
+
+/********************************************************************
+* mazeValidate returns FALSE for a valid maze, otherwise a set of the
+* MAZE_INVALID_* bits naming every problem found.
+********************************************************************/
+int mazeValidate(void)
+{ if(maze == NULL)
+  { return MAZE_INVALID_NO_MAZE;
+  }
+  int problems = FALSE;
+  size_t gridSize = (size_t)rows*columns;
+  setParent = malloc(gridSize*sizeof(size_t));
+  setRank = calloc(gridSize, sizeof(unsigned char));
+  if(setParent == NULL || setRank == NULL)
+  { printf("ERROR: Not enough memory to validate the maze\n");
+    free(setParent);
+    free(setRank);
+    return MAZE_INVALID_NO_MEMORY;
+  }
+
+  size_t wayPoint = (size_t)wayY*columns + wayX;
+  size_t entrance = NO_CELL, exitCell = NO_CELL;
+  size_t joined = 0;
+  size_t cell;
+  for(cell=0; cell<gridSize; ++cell)
+  { setParent[cell] = cell;
+  }
+  int i,j;
+
+  //Border: no direction bits at all
+  for(j=0; j<columns; ++j)
+  { if( (maze[0][j] | maze[rows-1][j]) & ALL_DIRECTIONS )
+    { problems |= MAZE_INVALID_BORDER;
+    }
+  }
+  for(i=0; i<rows; ++i)
+  { if( (maze[i][0] | maze[i][columns-1]) & ALL_DIRECTIONS )
+    { problems |= MAZE_INVALID_BORDER;
+    }
+  }
+
+  for(i=1; i<rows-1; ++i)
+  { const unsigned char* row = maze[i];
+    for(j=1; j<columns-1; ++j)
+    { cell = (size_t)i*columns + j;
+      int sides = row[j];
+
+      //Openings into the border
+      if( (j == 1 && (sides & WEST)) || (j == columns-2 && (sides & EAST)) )
+      { problems |= MAZE_INVALID_BORDER;
+      }
+      if(i == 1 && (sides & NORTH))
+      { if(entrance != NO_CELL) problems |= MAZE_INVALID_BORDER;
+        entrance = cell;
+      }
+      if(i == rows-2 && (sides & SOUTH))
+      { if(exitCell != NO_CELL) problems |= MAZE_INVALID_BORDER;
+        exitCell = cell;
+      }
+
+      //Each passage is seen once, from its west or north end
+      if(j < columns-2)
+      { int east = (sides & EAST) != 0;
+        if(east != ((row[j+1] & WEST) != 0))
+        { problems |= MAZE_INVALID_ASYMMETRIC;
+        }
+        if(east && cell != wayPoint && cell+1 != wayPoint)
+        { if(joinSets(cell, cell+1)) problems |= MAZE_INVALID_CYCLE;
+          ++joined;
+        }
+      }
+      if(i < rows-2)
+      { int south = (sides & SOUTH) != 0;
+        if(south != ((maze[i+1][j] & NORTH) != 0))
+        { problems |= MAZE_INVALID_ASYMMETRIC;
+        }
+        if(south && cell != wayPoint && cell+columns != wayPoint)
+        { if(joinSets(cell, cell+columns)) problems |= MAZE_INVALID_CYCLE;
+          ++joined;
+        }
+      }
+    }
+  }
+  if(entrance == NO_CELL || exitCell == NO_CELL)
+  { problems |= MAZE_INVALID_BORDER;
+  }
+  else if(entrance != wayPoint && exitCell != wayPoint &&
+          findSet(entrance) == findSet(exitCell))
+  { problems |= MAZE_INVALID_WAYPOINT;
+  }
+
+  //Now the waypoint's own passages
+  int d;
+  for(d=0; d<TOTAL_DIRECTIONS; ++d)
+  { int nextRow = wayY + DIRECTION_DY[d], nextColumn = wayX + DIRECTION_DX[d];
+    size_t next = (size_t)nextRow*columns + nextColumn;
+    if( (maze[wayY][wayX] & DIRECTION_LIST[d]) &&
+        nextRow > 0 && nextRow < rows-1 &&
+        nextColumn > 0 && nextColumn < columns-1 )
+    { if(joinSets(wayPoint, next)) problems |= MAZE_INVALID_CYCLE;
+      ++joined;
+    }
+  }
+
+  //A tree over the cells has one passage fewer than it has cells
+  if( !(problems & MAZE_INVALID_CYCLE) &&
+      joined != (size_t)(rows-2)*(columns-2) - 1 )
+  { problems |= MAZE_INVALID_UNREACHABLE;
+  }
+
+  free(setParent);
+  free(setRank);
+  return problems;
+}
+
+//Root of cell's set, halving the path on the way up
+static size_t findSet(size_t cell)
+{ while(setParent[cell] != cell)
+  { setParent[cell] = setParent[setParent[cell]];
+    cell = setParent[cell];
+  }
+  return cell;
+}
+
+//Joins the sets of a and b. Returns TRUE if they were already joined
+static int joinSets(size_t a, size_t b)
+{ a = findSet(a);
+  b = findSet(b);
+  if(a == b)
+  { return TRUE;
+  }
+  if(setRank[a] < setRank[b])
+  { size_t t = a; a = b; b = t;
+  }
+  setParent[b] = a;
+  if(setRank[a] == setRank[b])
+  { ++setRank[a];
+  }
+  return FALSE;
+}
@@ -0,0 +1,167 @@
+/********************************************************************
+* Window Rendering
+*
+* Draws any rectangle of cells at any scale, straight from the
+* direction bits instead of from the 8x8 blocks. Each cell gets a
+* square of cellPixels floor pixels, and walls are wallPixels thick
+* lines shared by the cells on both sides, so a window of w by h cells
+* is w*(cellPixels+wallPixels) + wallPixels pixels wide (and likewise
+* high). cellPixels = wallPixels = 1 is the smallest picture that
+* still shows every wall.
+*
+* Pixel rows come in two kinds of band: wall bands between two rows of
+* cells, and floor bands through a row of cells. Every row of a band
+* is the same, so each band's first row is built as a run of spans
+* (wall posts, walls, openings, floors) and copied down the band. The
+* cost is one write per output pixel, whatever the size of the maze.
+********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mazegen.h"
+#include "mazeModel.h"
+
+#define NO_COLOR 0xFFFFFFFF
+#define WINDOW_MAX_PIXELS (1 << 24)  //per side
+
+static unsigned char* fillSpan(unsigned char* dest, int count,
+                               unsigned int color);
+static unsigned int colorOf(int row, int col);
+static unsigned int passageColor(int rowA, int colA, int rowB, int colB);
+static void wallLine(unsigned char* line, int row, int x0, int w,
+                     int cellPixels, int wallPixels);
+static void floorLine(unsigned char* line, int row, int x0, int w,
+                      int cellPixels, int wallPixels);
+
+/********************************************************************
+* mazeRenderWindow draws the w by h cells of the current maze whose
+* top left cell is (x0, y0), counted from 1 like the waypoint, as a
+* bmp file image in a new buffer the caller frees. The solution and
+* waypoint are drawn as mazePrint draws them.
+*
+* Params:
+*   x0, y0, w, h: the window, which must lie inside the maze
+*   cellPixels: floor pixels across each cell, at least 1
+*   wallPixels: pixels across each wall, at least 1
+*   imageSize: set to the size of the image in bytes
+*
+* Returns the image, or NULL if there is no maze or an argument is out
+*   of range.
+********************************************************************/
+unsigned char* mazeRenderWindow(int x0, int y0, int w, int h,
+                                int cellPixels, int wallPixels,
+                                size_t* imageSize)
+{ if(maze == NULL || x0 < 1 || y0 < 1 || w < 1 || h < 1 ||
+     x0+w-1 > columns-2 || y0+h-1 > rows-2 ||
+     cellPixels < 1 || wallPixels < 1 ||
+     (double)(cellPixels+wallPixels)*(w > h ? w : h) + wallPixels >
+       WINDOW_MAX_PIXELS)
+  { printf("ERROR: Window out of range\n");
+    return NULL;
+  }
+  int pitch = cellPixels + wallPixels;
+  int pixelWidth = w*pitch + wallPixels;
+  int pixelHeight = h*pitch + wallPixels;
+  *imageSize = imageFileSize(pixelWidth, pixelHeight);
+  unsigned char* image = malloc(*imageSize);
+  if(image == NULL)
+  { printf("ERROR: Window too large\n");
+    return NULL;
+  }
+  imageHeader(image, pixelWidth, pixelHeight);
+  size_t lineBytes = (size_t)pixelWidth*COLOR_DEPTH_IN_BYTES;
+
+  int row, y = 0, k;
+  for(row=y0; row<=y0+h; ++row)
+  { //Wall band above cell row row (below the last row at the end)
+    unsigned char* line = imagePixel(image, pixelWidth, pixelHeight, 0, y);
+    wallLine(line, row, x0, w, cellPixels, wallPixels);
+    for(k=1; k<wallPixels; ++k)
+    { memcpy(imagePixel(image, pixelWidth, pixelHeight, 0, y+k), line,
+             lineBytes);
+    }
+    y += wallPixels;
+    if(row == y0+h)
+    { break;
+    }
+    line = imagePixel(image, pixelWidth, pixelHeight, 0, y);
+    floorLine(line, row, x0, w, cellPixels, wallPixels);
+    for(k=1; k<cellPixels; ++k)
+    { memcpy(imagePixel(image, pixelWidth, pixelHeight, 0, y+k), line,
+             lineBytes);
+    }
+    y += cellPixels;
+  }
+  return image;
+}
+
+//Writes count pixels of color from dest and returns the pixel after
+static unsigned char* fillSpan(unsigned char* dest, int count,
+                               unsigned int color)
+{ int m;
+  for(m=0; m<count; ++m)
+  { dest[0] = (unsigned char)(color);
+    dest[1] = (unsigned char)(color >> 8);
+    dest[2] = (unsigned char)(color >> 16);
+    dest += COLOR_DEPTH_IN_BYTES;
+  }
+  return dest;
+}
+
+//Floor color of the cell at row, col, or NO_COLOR for the border
+static unsigned int colorOf(int row, int col)
+{ if(maze[row][col] & SPECIAL)
+  { return NO_COLOR;
+  }
+  return floorColor(maze[row][col], row == wayY && col == wayX);
+}
+
+/********************************************************************
+* passageColor picks the color of an opening between two cells, one
+* of which may be the border. The path stays highlighted through an
+* opening only when the cells on both sides are highlighted.
+********************************************************************/
+static unsigned int passageColor(int rowA, int colA, int rowB, int colB)
+{ unsigned int a = colorOf(rowA, colA), b = colorOf(rowB, colB);
+  if(a == NO_COLOR) return b;
+  if(b == NO_COLOR || a == b) return a;
+  return (a != FLOOR_COLOR && b != FLOOR_COLOR) ? SOLUTION_COLOR
+                                                 : FLOOR_COLOR;
+}
+
+/********************************************************************
+* wallLine builds one pixel row of the wall band between cell rows
+* row-1 and row: a post at every corner, and across each cell a wall
+* or, where the cells are joined, an opening.
+********************************************************************/
+static void wallLine(unsigned char* line, int row, int x0, int w,
+                     int cellPixels, int wallPixels)
+{ int col;
+  for(col=x0; col<x0+w; ++col)
+  { line = fillSpan(line, wallPixels, WALL_COLOR);
+    int open = (maze[row][col] & SPECIAL) ? (maze[row-1][col] & SOUTH)
+                                          : (maze[row][col] & NORTH);
+    line = fillSpan(line, cellPixels,
+                    open ? passageColor(row-1, col, row, col) : WALL_COLOR);
+  }
+  fillSpan(line, wallPixels, WALL_COLOR);
+}
+
+/********************************************************************
+* floorLine builds one pixel row of the floor band through cell row
+* row: the cells' floors with a wall or an opening between each two,
+* and at both ends of the window.
+********************************************************************/
+static void floorLine(unsigned char* line, int row, int x0, int w,
+                      int cellPixels, int wallPixels)
+{ int col;
+  for(col=x0; col<x0+w; ++col)
+  { line = fillSpan(line, wallPixels, (maze[row][col] & WEST) ?
+                    passageColor(row, col-1, row, col) : WALL_COLOR);
+    line = fillSpan(line, cellPixels, colorOf(row, col));
+  }
+  col = x0+w-1;
+  fillSpan(line, wallPixels, (maze[row][col] & EAST) ?
+           passageColor(row, col, row, col+1) : WALL_COLOR);
+}